@@ -53,12 +53,15 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes (8, 16, 32 or 64; "make ALIGN=16"
+ * overrides it for payloads that hold SIMD vectors)
  */
+#ifndef ALIGNMENT
 #define ALIGNMENT 8  
+#endif
 
 /* 
- * Maximum heap size in bytes 
+ * Default maximum heap size in bytes (mdriver -M overrides it)
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
@@ -0,0 +1,82 @@
+/*
+ * ftlb.c - Count the data TLB misses taken by a function f
+ *
+ * Uses the Linux perf_event_open interface to count dTLB load and store
+ * misses in user mode. Not every CPU counts store misses, so those are
+ * added in only when the counter exists. Counting may also be refused
+ * outright (see /proc/sys/kernel/perf_event_paranoid), in which case
+ * init_ftlb fails and ftlb returns -1.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "ftlb.h"
+
+/* Counter file descriptors: dTLB load misses, dTLB store misses */
+static int tlb_fd[2] = {-1, -1};
+
+/* function prototypes */
+static int open_counter(unsigned long long op);
+
+/*
+ * init_ftlb - Open the dTLB miss counters for this process
+ */
+int init_ftlb(void)
+{
+    if (tlb_fd[0] < 0)
+	tlb_fd[0] = open_counter(PERF_COUNT_HW_CACHE_OP_READ);
+    if (tlb_fd[0] < 0)
+	return -1;
+    if (tlb_fd[1] < 0)
+	tlb_fd[1] = open_counter(PERF_COUNT_HW_CACHE_OP_WRITE);
+    return 0;
+}
+
+/*
+ * ftlb - Count the dTLB misses of one run of f(argp)
+ */
+long long ftlb(ftlb_test_funct f, void *argp)
+{
+    long long count, total = 0;
+    int i;
+
+    if (init_ftlb() < 0)
+	return -1;
+    for (i = 0; i < 2; i++) {
+	if (tlb_fd[i] >= 0) {
+	    ioctl(tlb_fd[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(tlb_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+    f(argp);
+    for (i = 0; i < 2; i++) {
+	if (tlb_fd[i] >= 0) {
+	    ioctl(tlb_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+	    if (read(tlb_fd[i], &count, sizeof(count)) == sizeof(count))
+		total += count;
+	}
+    }
+    return total;
+}
+
+/*
+ * open_counter - Open a disabled user-mode counter of dTLB misses for
+ * the given operation (read or write)
+ */
+static int open_counter(unsigned long long op)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (op << 8) |
+	(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
@@ -0,0 +1,12 @@
+/* 
+ * Data TLB miss counters
+ */
+typedef void (*ftlb_test_funct)(void *); 
+
+/* Open the hardware counters. Return 0 on success, -1 if the system
+   does not let us count dTLB misses */
+int init_ftlb(void);
+
+/* Count the dTLB misses of one run of f(argp). Return -1 if the 
+   counters could not be opened */
+long long ftlb(ftlb_test_funct f, void *argp);
@@ -15,11 +15,15 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "ftlb.h"
 #include "config.h"
+#include "trace.h"
 
 /**********************
  * Constants and macros
@@ -29,38 +33,25 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define RSS_SAMPLES   64 /* resident set samples per trace (-R) */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
-typedef struct range_t {
-    char *lo;              /* low payload address */
-    char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
-} range_t;
-
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
+/* 
+ * Records the extent of each block's payload, as a shadow bitmap of 
+ * the heap with one bit per ALIGNMENT bytes. A bit is set iff its bytes
+ * belong to an allocated payload.
+ */
 typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
+    unsigned char *bits;   /* the bitmap */
+    size_t nbits;          /* bits in the bitmap, covering the max heap */
+    size_t hwm;            /* bytes of bits[] that may be nonzero */
+} range_t;
 
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
@@ -70,6 +61,11 @@ typedef struct {
 typedef struct {
     trace_t *trace;  
     range_t *ranges;
+    int start;       /* first request to run; if nonzero, the requests
+			before it are a warm-up whose heap is restored
+			from a memlib snapshot */
+    int end;         /* one past the last request to run */
+    char **blocks;   /* the trace's block pointers after the warm-up */
 } speed_t;
 
 /* Summarizes the important stats for some malloc function on some trace */
@@ -81,14 +77,32 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double rss_util; /* peak payload over peak resident bytes (-R only) */
+    double faults;   /* page faults per thousand ops (-R only) */
+    double calloc_bytes; /* bytes requested by calloc in the util run */
+    double calloc_zero;  /* of those, bytes mm_calloc knew were zero */
+    double util_nohint;  /* util with lifetime hints ignored, 0 if the
+			    trace has no hints */
+    double util_compact; /* util with handles and mm_compact (-C only) */
+    double fit_searches; /* large free block searches in the util run */
+    double fit_blocks;   /* free blocks those searches looked at */
+    double fit_bytes;    /* address distance between those blocks */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* Parameters of the batch microbenchmark's timed runs */
+typedef struct {
+    int n;           /* blocks per batch */
+    int size;        /* payload bytes per block */
+    void **ptrs;     /* the blocks */
+} batch_t;
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
+static int use_hints = 1; /* pass lifetime hints on to mm_malloc_hint */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
@@ -105,15 +119,14 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
+/* these functions manipulate the range bitmap */
+static void init_ranges(range_t *ranges);
+static int add_range(range_t *ranges, char *lo, int size, 
 		     int tracenum, int opnum);
-static void remove_range(range_t **ranges, char *lo);
-static void clear_ranges(range_t **ranges);
-
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
+static void remove_range(range_t *ranges, char *lo, int size);
+static void clear_ranges(range_t *ranges);
+static int check_usable(char *p, int size, int tracenum, int opnum);
+static void check_bad_free(void);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -121,12 +134,32 @@ static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static int eval_mm_valid(trace_t *trace, int tracenum, range_t *ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t *ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_warmup(speed_t *params, int pct, int tracenum);
+static void eval_mm_rss(trace_t *trace, stats_t *stats);
+static double eval_mm_compact(trace_t *trace, int tracenum, int period);
+static void eval_mm_hugepages(int n, char **tracefiles, stats_t *stats);
+static void eval_mm_procs(int n, char **tracefiles, stats_t *stats,
+			  int nprocs);
+static int eval_mm_shared(trace_t *trace, int id);
+static void eval_mm_batch(int n);
+static void eval_mm_loop_speed(void *ptr);
+static void eval_mm_batch_speed(void *ptr);
+static void eval_mm_region_speed(void *ptr);
+static void eval_mm_pool_speed(void *ptr);
+static int check_batch(batch_t *params);
+
+/* Gives allocations lifetime hints from the trace itself (-L) */
+static int oracle_hints(trace_t *trace, int short_ops);
+
+/* Issue an ALLOC, MEMALIGN or CALLOC request to either package */
+static char *mm_alloc_op(traceop_t *op);
+static char *libc_alloc_op(traceop_t *op);
 
 /* Various helper routines */
-static void printresults(int n, stats_t *stats);
+static void printresults(int n, stats_t *stats, int rss);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -137,12 +170,13 @@ static void app_error(char *msg);
  **************/
 int main(int argc, char **argv)
 {
-    int i;
+    int i, j;
+    int hinted;
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
+    range_t ranges;            /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
@@ -150,6 +184,13 @@ int main(int argc, char **argv)
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int hugepages = 0;   /* If set, compare dTLB misses on huge pages (-H) */
+    int rss = 0;         /* If set, measure resident pages and faults (-R) */
+    int warmup = 0;      /* Percent of each trace to run before timing (-w) */
+    int procs = 0;       /* Processes to run on one shared heap (-P) */
+    int batch = 0;       /* Blocks per batch in the batch benchmark (-B) */
+    int hint_ops = 0;    /* Oracle lifetime hint horizon in requests (-L) */
+    int compact = 0;     /* Requests between mm_compact calls (-C) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +199,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:M:T:D:w:P:B:L:C:S:hvVgalAHR")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -178,12 +219,61 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+	case 'M': /* Maximum heap size in MB */
+	    mem_set_maxheap((size_t)strtoul(optarg, NULL, 0) << 20);
+	    break;
+	case 'T': /* Size at which requests get their own mapping */
+	    if (!mm_setopt(MM_OPT_MMAP_THRESHOLD, strtol(optarg, NULL, 0)))
+		app_error("Bad -T threshold");
+	    break;
+	case 'D': /* Requests per purge epoch */
+	    if (!mm_setopt(MM_OPT_PURGE_DECAY, strtol(optarg, NULL, 0)))
+		app_error("Bad -D decay");
+	    break;
+	case 'S': /* Size from which blocks are cut from the end */
+	    if (!mm_setopt(MM_OPT_SPLIT_SIZE, strtol(optarg, NULL, 0)))
+		app_error("Bad -S size");
+	    break;
+	case 'A': /* Keep large free blocks in address order */
+	    mm_setopt(MM_OPT_ADDR_ORDER, 1);
+	    break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+	case 'H': /* Compare dTLB misses with and without huge pages */
+	    hugepages = 1;
+	    break;
+	case 'R': /* Measure the resident set and page faults */
+	    rss = 1;
+	    break;
+	case 'P': /* Run the traces in several processes on one heap */
+	    procs = atoi(optarg);
+	    if (procs < 1)
+		app_error("Bad -P process count");
+	    break;
+	case 'B': /* Time batch calls against loops of single calls */
+	    batch = atoi(optarg);
+	    if (batch < 1)
+		app_error("Bad -B batch size");
+	    break;
+	case 'L': /* Hint each allocation with its actual lifetime */
+	    hint_ops = atoi(optarg);
+	    if (hint_ops < 1)
+		app_error("Bad -L lifetime");
+	    break;
+	case 'C': /* Rerun the traces on handles, compacting periodically */
+	    compact = atoi(optarg);
+	    if (compact < 1)
+		app_error("Bad -C period");
+	    break;
+	case 'w': /* Time each trace from a heap aged by a prefix of it */
+	    warmup = atoi(optarg);
+	    if (warmup < 0 || warmup > 99)
+		app_error("Bad -w percentage");
+	    break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -252,6 +342,8 @@ int main(int argc, char **argv)
 	
 	/* Evaluate the libc malloc package using the K-best scheme */
 	for (i=0; i < num_tracefiles; i++) {
+	    if (verbose > 1)
+		printf("Reading tracefile: %s\n", tracefiles[i]);
 	    trace = read_trace(tracedir, tracefiles[i]);
 	    libc_stats[i].ops = trace->num_ops;
 	    if (verbose > 1)
@@ -269,7 +361,7 @@ int main(int argc, char **argv)
 	/* Display the libc results in a compact table */
 	if (verbose) {
 	    printf("\nResults for libc malloc:\n");
-	    printresults(num_tracefiles, libc_stats);
+	    printresults(num_tracefiles, libc_stats, 0);
 	}
     }
 
@@ -286,10 +378,15 @@ int main(int argc, char **argv)
     
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
+    init_ranges(&ranges);
+    check_bad_free();
 
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
+	if (verbose > 1)
+	    printf("Reading tracefile: %s\n", tracefiles[i]);
 	trace = read_trace(tracedir, tracefiles[i]);
+	hinted = hint_ops ? oracle_hints(trace, hint_ops) : 0;
 	mm_stats[i].ops = trace->num_ops;
 	if (verbose > 1)
 	    printf("Checking mm_malloc for correctness, ");
@@ -297,12 +394,37 @@ int main(int argc, char **argv)
 	if (mm_stats[i].valid) {
 	    if (verbose > 1)
 		printf("efficiency, ");
+	    for (j = 0; !hinted && j < trace->num_ops; j++)
+		hinted = (trace->ops[j].hint != MM_HINT_NONE);
+	    if (hinted) {
+		use_hints = 0;
+		mm_stats[i].util_nohint = eval_mm_util(trace, i, &ranges);
+		use_hints = 1;
+	    }
 	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+	    mm_stats[i].calloc_bytes = mm_stat(MM_STAT_CALLOC_BYTES);
+	    mm_stats[i].calloc_zero = mm_stat(MM_STAT_CALLOC_ZERO);
+	    mm_stats[i].fit_searches = mm_stat(MM_STAT_FIT_SEARCHES);
+	    mm_stats[i].fit_blocks = mm_stat(MM_STAT_FIT_BLOCKS);
+	    mm_stats[i].fit_bytes = mm_stat(MM_STAT_FIT_BYTES);
+	    if (rss)
+		eval_mm_rss(trace, &mm_stats[i]);
+	    if (compact)
+		mm_stats[i].util_compact = eval_mm_compact(trace, i, compact);
 	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
+	    speed_params.ranges = &ranges;
+	    speed_params.start = 0;
+	    speed_params.end = trace->num_ops;
+	    if (warmup)
+		eval_mm_warmup(&speed_params, warmup, i);
 	    if (verbose > 1)
 		printf("and performance.\n");
 	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+	    if (speed_params.start > 0) {
+		mm_stats[i].ops = trace->num_ops - speed_params.start;
+		mem_snapshot_drop();
+		free(speed_params.blocks);
+	    }
 	}
 	free_trace(trace);
     }
@@ -310,10 +432,23 @@ int main(int argc, char **argv)
     /* Display the mm results in a compact table */
     if (verbose) {
 	printf("\nResults for mm malloc:\n");
-	printresults(num_tracefiles, mm_stats);
+	printresults(num_tracefiles, mm_stats, rss);
 	printf("\n");
     }
 
+    /* Rerun the valid traces on ordinary and huge pages */
+    if (hugepages)
+	eval_mm_hugepages(num_tracefiles, tracefiles, mm_stats);
+
+    /* Rerun the valid traces in several processes sharing one heap */
+    if (procs)
+	eval_mm_procs(num_tracefiles, tracefiles, mm_stats, procs);
+
+    /* Compare batches, regions and pools with the same work done one
+       call at a time */
+    if (batch)
+	eval_mm_batch(batch);
+
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
      */
@@ -367,22 +502,39 @@ int main(int argc, char **argv)
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range bitmap, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range bitmap to detect any overlapping allocated blocks. Checking 
+ * a block costs time in proportion to its size, not to the number 
+ * of live blocks, so that very large traces remain practical.
  ****************************************************************/
 
+/* Bit number in the range bitmap of the heap address p */
+#define RANGE_BIT(p) ((size_t)((char *)(p) - (char *)mem_heap_lo()) / ALIGNMENT)
+
+/*
+ * init_ranges - Allocate an empty range bitmap covering the largest
+ *     heap that memlib can give out
+ */
+static void init_ranges(range_t *ranges)
+{
+    ranges->nbits = mem_maxheap() / ALIGNMENT;
+    ranges->hwm = 0;
+    if ((ranges->bits = calloc(ranges->nbits / 8 + 1, 1)) == NULL)
+	unix_error("calloc error in init_ranges");
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we mark its extent in the range bitmap.
  */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(range_t *ranges, char *lo, int size, 
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    size_t b, blo, bhi;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -395,9 +547,14 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
+    /* 
+     * The payload must lie within the extent of the heap, or else in
+     * one of memlib's direct mappings, which never overlap anything
+     */
     if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
 	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+	if (mem_is_mapped(lo, size))
+	    return 1;
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
@@ -405,167 +562,108 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
+    blo = RANGE_BIT(lo);
+    bhi = RANGE_BIT(hi);
+    for (b = blo; b <= bhi; b++) {
+	if (ranges->bits[b / 8] & (1 << (b % 8))) {
+	    sprintf(msg, "Payload (%p:%p) overlaps another payload at %p\n",
+		    lo, hi, (char *)mem_heap_lo() + b * ALIGNMENT);
 	    malloc_error(tracenum, opnum, msg);
 	    return 0;
-        }
+	}
     }
 
-    /* 
-     * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
-     */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
-    p->lo = lo;
-    p->hi = hi;
-    *ranges = p;
+    /* Everything looks OK, so remember the extent of this block */
+    for (b = blo; b <= bhi; b++)
+	ranges->bits[b / 8] |= 1 << (b % 8);
+    if (bhi / 8 + 1 > ranges->hwm)
+	ranges->hwm = bhi / 8 + 1;
     return 1;
 }
 
 /* 
- * remove_range - Free the range record of block whose payload starts at lo 
+ * remove_range - Clear the extent of the size-byte payload at lo 
  */
-static void remove_range(range_t **ranges, char *lo)
+static void remove_range(range_t *ranges, char *lo, int size)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    int size;
+    size_t b, bhi = RANGE_BIT(lo + size - 1);
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
-    }
+    if (lo < (char *)mem_heap_lo() || lo > (char *)mem_heap_hi())
+	return; /* in a direct mapping */
+
+    for (b = RANGE_BIT(lo); b <= bhi; b++)
+	ranges->bits[b / 8] &= ~(1 << (b % 8));
 }
 
 /*
- * clear_ranges - free all of the range records for a trace 
+ * clear_ranges - forget all of the block extents for a trace 
  */
-static void clear_ranges(range_t **ranges)
+static void clear_ranges(range_t *ranges)
 {
-    range_t *p;
-    range_t *pnext;
-
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
-    *ranges = NULL;
+    memset(ranges->bits, 0, ranges->hwm);
+    ranges->hwm = 0;
 }
 
-
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
-
 /*
- * read_trace - read a trace file and store it in memory
+ * check_usable - The size-byte block at p, returned by request opnum,
+ *     must have at least size usable bytes. The caller then treats all
+ *     of them as the block's, in the range bitmap and when filling it.
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static int check_usable(char *p, int size, int tracenum, int opnum)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
-
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
-
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
-	}
-	op_index++;
-	
+    if (mm_usable_size(p) < (size_t)size) {
+	sprintf(msg, "mm_usable_size of %p is %lu, less than the %d bytes "
+		"requested", p, (unsigned long)mm_usable_size(p), size);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
+    return 1;
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * check_bad_free - Check, on a heap of its own, that mm_free_sized
+ *     turns down a free with more bytes than the block holds, and a
+ *     double free: each must be counted in MM_STAT_BAD_FREES, and the
+ *     first must leave the block allocated with its data.
  */
-void free_trace(trace_t *trace)
+static void check_bad_free(void)
 {
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
+    size_t j, usable;
+    long bad;
+    int ok;
+    char *p, *q;
+
+    mem_reset_heap();
+    if (mm_init() < 0)
+	app_error("mm_init failed in check_bad_free");
+    if ((p = mm_malloc(100)) == NULL || mm_malloc(100) == NULL)
+	app_error("mm_malloc failed in check_bad_free");
+    usable = mm_usable_size(p);
+    memset(p, 0x5a, usable);
+    bad = mm_stat(MM_STAT_BAD_FREES);
+
+    mm_free_sized(p, usable + 1);
+    ok = (mm_stat(MM_STAT_BAD_FREES) == bad + 1 && mm_usable_size(p) == usable);
+    for (j = 0; ok && j < usable; j++)
+	ok = (p[j] == 0x5a);
+    if ((q = mm_malloc(usable)) == NULL)
+	app_error("mm_malloc failed in check_bad_free");
+    if (q < p + usable && p < q + mm_usable_size(q))
+	ok = 0;
+
+    mm_free_sized(p, 100);
+    mm_free_sized(p, 100);
+    if (mm_stat(MM_STAT_BAD_FREES) != bad + 2)
+	ok = 0;
+
+    if (!ok) {
+	errors++;
+	printf("ERROR: mm_free_sized freed a block with a wrong size, or twice\n");
+    }
+    mem_reset_heap();
 }
 
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -574,17 +672,18 @@ void free_trace(trace_t *trace)
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
+static int eval_mm_valid(trace_t *trace, int tracenum, range_t *ranges) 
 {
     int i, j;
     int index;
     int size;
     int oldsize;
+    size_t usable;
     char *newp;
     char *oldp;
     char *p;
     
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and clear the range bitmap */
     mem_reset_brk();
     clear_ranges(ranges);
 
@@ -602,27 +701,47 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
+	    if ((p = mm_alloc_op(&trace->ops[i])) == NULL) {
+		malloc_error(tracenum, i, (trace->ops[i].type == ALLOC) ?
+			     "mm_malloc failed." : (trace->ops[i].type == CALLOC) ?
+			     "mm_calloc failed." : "mm_memalign failed.");
 		return 0;
 	    }
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
-	     * and must not overlap any currently allocated block. 
+	     * to the range bitmap if OK. The block must be  be aligned properly,
+	     * and must not overlap any currently allocated block, up to
+	     * its usable size. 
 	     */ 
-	    if (add_range(ranges, p, size, tracenum, i) == 0)
+	    if (!check_usable(p, size, tracenum, i) ||
+		add_range(ranges, p, mm_usable_size(p), tracenum, i) == 0)
 		return 0;
+	    if (trace->ops[i].type == MEMALIGN &&
+		(unsigned long)p % trace->ops[i].align != 0) {
+		sprintf(msg, "mm_memalign payload (%p) not aligned to %d bytes",
+			p, trace->ops[i].align);
+		malloc_error(tracenum, i, msg);
+		return 0;
+	    }
+	    if (trace->ops[i].type == CALLOC) {
+		for (j = 0; j < size; j++)
+		    if (p[j] != 0) {
+			malloc_error(tracenum, i, "mm_calloc did not zero the block");
+			return 0;
+		    }
+	    }
 	    
 	    /* ADDED: cgw
 	     * fill range with low byte of index.  This will be used later
 	     * if we realloc the block and wish to make sure that the old
 	     * data was copied to the new block
 	     */
-	    memset(p, index & 0xFF, size);
+	    memset(p, index & 0xFF, mm_usable_size(p));
 
 	    /* Remember region */
 	    trace->blocks[index] = p;
@@ -633,16 +752,18 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
+	    usable = mm_usable_size(oldp);
 	    if ((newp = mm_realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
 	    
-	    /* Remove the old region from the range list */
-	    remove_range(ranges, oldp);
+	    /* Remove the old region from the range bitmap */
+	    remove_range(ranges, oldp, usable);
 	    
-	    /* Check new block for correctness and add it to range list */
-	    if (add_range(ranges, newp, size, tracenum, i) == 0)
+	    /* Check new block for correctness and add it to range bitmap */
+	    if (!check_usable(newp, size, tracenum, i) ||
+		add_range(ranges, newp, mm_usable_size(newp), tracenum, i) == 0)
 		return 0;
 	    
 	    /* ADDED: cgw
@@ -653,25 +774,30 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
 	      }
 	    }
-	    memset(newp, index & 0xFF, size);
+	    memset(newp, index & 0xFF, mm_usable_size(newp));
 
 	    /* Remember region */
 	    trace->blocks[index] = newp;
 	    trace->block_sizes[index] = size;
 	    break;
 
-        case FREE: /* mm_free */
+        case FREE: /* mm_free or mm_free_sized */
 	    
-	    /* Remove region from list and call student's free function */
+	    /* Remove region from list and call student's free function.
+	       Odd blocks go to mm_free_sized, with the size that they were
+	       requested with */
 	    p = trace->blocks[index];
-	    remove_range(ranges, p);
-	    mm_free(p);
+	    remove_range(ranges, p, mm_usable_size(p));
+	    if (index % 2 == 1)
+		mm_free_sized(p, trace->block_sizes[index]);
+	    else
+		mm_free(p);
 	    break;
 
 	default:
@@ -688,25 +814,26 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
- *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
+ *   Utilization is the ratio hwm/footprint, where footprint is the 
+ *   peak size in bytes of the heap plus any direct mappings while 
+ *   running the student's malloc package on the trace. Note that our
+ *   implementation of mem_sbrk() doesn't allow the students to 
+ *   decrement the brk pointer, so without mappings this is just the
+ *   final heap size. 
  *   
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t *ranges)
 {   
     int i;
     int index;
     int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
     char *p;
     char *newp, *oldp;
 
-    /* initialize the heap and the mm malloc package */
-    mem_reset_brk();
+    /* initialize a fresh heap and the mm malloc package */
+    mem_reset_heap();
     if (mm_init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
@@ -714,10 +841,12 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = mm_alloc_op(&trace->ops[i])) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -774,9 +903,201 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)mem_footprint());
+}
+
+
+/*
+ * eval_mm_rss - Measure the physical memory cost of the student's
+ *   package. The trace is replayed on a heap with no resident pages,
+ *   writing every payload as a program would. The resident bytes of
+ *   the heap and mappings are sampled RSS_SAMPLES times during the run,
+ *   and resident-set util is the peak payload over the largest sample.
+ *   Unlike util, this charges for every page the package touches, and
+ *   not for committed pages that it never touches or has purged.
+ *   The page faults taken during the run are reported per 1000 ops.
+ */
+static void eval_mm_rss(trace_t *trace, stats_t *stats)
+{
+    int i, index, size, newsize, oldsize, period;
+    size_t max_total_size = 0, total_size = 0, resident, max_resident = 0;
+    long faults;
+    char *p;
+    struct rusage ru;
+
+    /* Start from an empty heap with no resident pages */
+    mem_reset_brk();
+    mem_purge(mem_heap_lo(), mem_maxheap());
+    getrusage(RUSAGE_SELF, &ru);
+    faults = ru.ru_minflt + ru.ru_majflt;
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_rss");
+
+    period = trace->num_ops / RSS_SAMPLES + 1;
+    for (i = 0;  i < trace->num_ops;  i++) {
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = mm_alloc_op(&trace->ops[i])) == NULL)
+		app_error("mm_malloc failed in eval_mm_rss");
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    index = trace->ops[i].index;
+	    newsize = trace->ops[i].size;
+	    oldsize = trace->block_sizes[index];
+	    if ((p = mm_realloc(trace->blocks[index], newsize)) == NULL)
+		app_error("mm_realloc failed in eval_mm_rss");
+	    if (newsize > oldsize)
+		memset(p + oldsize, index & 0xFF, newsize - oldsize);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = newsize;
+	    total_size += (newsize - oldsize);
+	    break;
+
+        case FREE: /* mm_free */
+	    index = trace->ops[i].index;
+	    mm_free(trace->blocks[index]);
+	    total_size -= trace->block_sizes[index];
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_rss");
+        }
+
+	max_total_size = (total_size > max_total_size) ?
+	    total_size : max_total_size;
+	if ((i + 1) % period == 0 || i == trace->num_ops - 1) {
+	    resident = mem_resident();
+	    max_resident = (resident > max_resident) ? resident : max_resident;
+	}
+    }
+
+    getrusage(RUSAGE_SELF, &ru);
+    faults = ru.ru_minflt + ru.ru_majflt - faults;
+    stats->rss_util = max_resident ?
+	(double)max_total_size / (double)max_resident : 0.0;
+    stats->faults = trace->num_ops ? 1e3 * faults / trace->num_ops : 0.0;
+}
+
+/*
+ * eval_mm_compact - Measure util with every block behind a handle and
+ *   mm_compact called every period requests. A realloc is a new
+ *   handle, a copy and a free. Blocks are written when allocated and
+ *   checked when freed, to catch moves that lose data.
+ */
+static double eval_mm_compact(trace_t *trace, int tracenum, int period)
+{
+    int i, j, index, size, newsize, oldsize;
+    size_t max_total_size = 0, total_size = 0;
+    mm_handle_t *handles, h;
+    char *p, *oldp;
+
+    if ((handles = calloc(trace->num_ids, sizeof(mm_handle_t))) == NULL)
+	unix_error("calloc error in eval_mm_compact");
+
+    /* initialize a fresh heap and the mm malloc package */
+    mem_reset_heap();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_compact");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_halloc */
+        case MEMALIGN:
+        case CALLOC:
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((h = mm_halloc(size)) == 0)
+		app_error("mm_halloc failed in eval_mm_compact");
+	    memset(mm_hlock(h), index & 0xFF, size);
+	    mm_hunlock(h);
+	    handles[index] = h;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    break;
+
+	case REALLOC: /* mm_halloc, copy and mm_hfree */
+	    index = trace->ops[i].index;
+	    newsize = trace->ops[i].size;
+	    oldsize = trace->block_sizes[index];
+	    if ((h = mm_halloc(newsize)) == 0)
+		app_error("mm_halloc failed in eval_mm_compact");
+	    p = mm_hlock(h);
+	    oldp = mm_hlock(handles[index]);
+	    memcpy(p, oldp, (newsize < oldsize) ? newsize : oldsize);
+	    if (newsize > oldsize)
+		memset(p + oldsize, index & 0xFF, newsize - oldsize);
+	    mm_hunlock(h);
+	    mm_hfree(handles[index]);
+	    handles[index] = h;
+	    trace->block_sizes[index] = newsize;
+	    total_size += (newsize - oldsize);
+	    break;
+
+        case FREE: /* mm_hfree */
+	    index = trace->ops[i].index;
+	    size = trace->block_sizes[index];
+	    p = mm_hlock(handles[index]);
+	    for (j = 0; j < size; j++)
+		if (p[j] != (char)(index & 0xFF)) {
+		    malloc_error(tracenum, i, "mm_compact lost the data of a block");
+		    break;
+		}
+	    mm_hfree(handles[index]);
+	    total_size -= size;
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_compact");
+        }
+
+	max_total_size = (total_size > max_total_size) ?
+	    total_size : max_total_size;
+	if ((i + 1) % period == 0)
+	    mm_compact();
+    }
+
+    free(handles);
+    return ((double)max_total_size / (double)mem_footprint());
 }
 
+/*
+ * eval_mm_warmup - Age the heap by running the first pct percent of
+ *    the trace, then snapshot it, so that every timed run of
+ *    eval_mm_speed starts from the same aged heap instead of an empty
+ *    one. If the heap cannot be snapshotted, the whole trace is timed
+ *    as usual.
+ */
+static void eval_mm_warmup(speed_t *params, int pct, int tracenum)
+{
+    trace_t *trace = params->trace;
+    int start = (int)((double)trace->num_ops * pct / 100);
+
+    if (start == 0)
+	return;
+    params->end = start;
+    eval_mm_speed(params);
+    params->end = trace->num_ops;
+    if (mem_snapshot() < 0) {
+	printf("Trace %d: could not snapshot the heap, timing without warm-up\n",
+	       tracenum);
+	return;
+    }
+    if ((params->blocks = malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc failed in eval_mm_warmup");
+    memcpy(params->blocks, trace->blocks, trace->num_ids * sizeof(char *));
+    params->start = start;
+}
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
@@ -786,25 +1107,43 @@ static void eval_mm_speed(void *ptr)
 {
     int i, index, size, newsize;
     char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
-
-    /* Reset the heap and initialize the mm package */
-    mem_reset_brk();
-    if (mm_init() < 0) 
-	app_error("mm_init failed in eval_mm_speed");
+    speed_t *params = (speed_t *)ptr;
+    trace_t *trace = params->trace;
+
+    /* Start from the aged heap of the warm-up, or reset the heap and
+       initialize the mm package */
+    if (params->start > 0) {
+	mem_restore();
+	memcpy(trace->blocks, params->blocks, trace->num_ids * sizeof(char *));
+    }
+    else {
+	mem_reset_brk();
+	if (mm_init() < 0) 
+	    app_error("mm_init failed in eval_mm_speed");
+    }
 
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
+    for (i = params->start;  i < params->end;  i++)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = trace->ops[i].hint ?
+		 mm_malloc_hint(size, trace->ops[i].hint) :
+		 mm_malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
 
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            if ((p = mm_alloc_op(&trace->ops[i])) == NULL)
+		app_error("mm_memalign or mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
 	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -840,7 +1179,9 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
+        case MEMALIGN: /* posix_memalign */
+        case CALLOC: /* calloc */
+	    if ((p = libc_alloc_op(&trace->ops[i])) == NULL) {
 		malloc_error(tracenum, i, "libc malloc failed");
 		unix_error("System message");
 	    }
@@ -869,6 +1210,337 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
     return 1;
 }
 
+/*
+ * eval_mm_hugepages - Replay each valid trace on a heap of ordinary
+ *    pages and then on a heap of transparent huge pages, and print the
+ *    dTLB misses and running time of both, so we can tell whether huge
+ *    pages pay off for the package. The heap is left on ordinary pages.
+ */
+static void eval_mm_hugepages(int n, char **tracefiles, stats_t *stats)
+{
+    int i, huge;
+    long long misses[2];
+    double secs[2];
+    trace_t *trace;
+    speed_t speed_params;
+
+    if (init_ftlb() < 0)
+	printf("dTLB miss counters are not available, showing times only\n");
+    printf("Results on 4 KB pages vs. 2 MB huge pages:\n");
+    printf("%5s%14s%14s%8s%10s%10s\n",
+	   "trace", "4K dTLB miss", "2M dTLB miss", "change", "4K secs", "2M secs");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	speed_params.trace = trace;
+	speed_params.start = 0;
+	speed_params.end = trace->num_ops;
+	for (huge = 0; huge < 2; huge++) {
+	    mem_deinit();
+	    mem_set_hugepages(huge);
+	    mem_init();
+	    eval_mm_speed(&speed_params); /* commit and fault in the heap */
+	    misses[huge] = ftlb(eval_mm_speed, &speed_params);
+	    secs[huge] = fsecs(eval_mm_speed, &speed_params);
+	}
+	if (misses[0] >= 0)
+	    printf("%2d%17lld%14lld%7.1f%%%10.6f%10.6f\n", i, misses[0], misses[1],
+		   misses[0] ? 100.0 * (misses[1] - misses[0]) / misses[0] : 0.0,
+		   secs[0], secs[1]);
+	else
+	    printf("%2d%17s%14s%8s%10.6f%10.6f\n", i, "-", "-", "-",
+		   secs[0], secs[1]);
+	free_trace(trace);
+    }
+    mem_deinit();
+    mem_set_hugepages(0);
+    mem_init();
+    printf("\n");
+}
+
+/*
+ * eval_mm_batch - Allocate n blocks of one size and free them all: with
+ *    a loop of mm_malloc and mm_free calls, with mm_malloc_batch and
+ *    mm_free_batch, from a region that is then destroyed, and from a
+ *    pool. Print the times for several sizes. The batch, region and
+ *    pool blocks are first checked to be aligned and not to overlap.
+ */
+static void eval_mm_batch(int n)
+{
+    static int sizes[] = {16, 64, 256, 1024};
+    int i, j, valid;
+    double loop_secs, batch_secs, region_secs, pool_secs;
+    mm_region_t *r;
+    mm_pool_t *pool;
+    batch_t params;
+
+    if ((params.ptrs = malloc(n * sizeof(void *))) == NULL)
+	unix_error("malloc failed in eval_mm_batch");
+    params.n = n;
+
+    printf("Results for batches of %d blocks:\n", n);
+    printf("%5s%7s%11s%11s%8s%11s%8s%11s%8s\n", "size", " valid", "loop",
+	   "batch", "speedup", "region", "speedup", "pool", "speedup");
+    for (i = 0; i < sizeof(sizes) / sizeof(int); i++) {
+	params.size = sizes[i];
+
+	mem_reset_brk();
+	if (mm_init() < 0)
+	    app_error("mm_init failed in eval_mm_batch");
+	if (mm_malloc_batch(params.size, n, params.ptrs) != n)
+	    app_error("mm_malloc_batch failed in eval_mm_batch");
+	valid = check_batch(&params);
+	mm_free_batch(params.ptrs, n);
+	if ((r = mm_region_create()) == NULL)
+	    app_error("mm_region_create failed in eval_mm_batch");
+	for (params.n = 0; params.n < n; params.n++)
+	    if ((params.ptrs[params.n] = mm_region_alloc(r, params.size)) == NULL)
+		app_error("mm_region_alloc failed in eval_mm_batch");
+	valid = valid && check_batch(&params);
+	mm_region_destroy(r);
+	if ((pool = mm_pool_create(params.size)) == NULL)
+	    app_error("mm_pool_create failed in eval_mm_batch");
+	for (j = 0; j < n; j++)
+	    if ((params.ptrs[j] = mm_pool_alloc(pool)) == NULL)
+		app_error("mm_pool_alloc failed in eval_mm_batch");
+	valid = valid && check_batch(&params);
+	for (j = 0; j < n; j++)
+	    mm_pool_free(pool, params.ptrs[j]);
+	mm_pool_destroy(pool);
+	if (!valid) {
+	    errors++;
+	    printf("%5d%7s\n", params.size, "no");
+	    continue;
+	}
+
+	loop_secs = fsecs(eval_mm_loop_speed, &params);
+	batch_secs = fsecs(eval_mm_batch_speed, &params);
+	region_secs = fsecs(eval_mm_region_speed, &params);
+	pool_secs = fsecs(eval_mm_pool_speed, &params);
+	printf("%5d%7s%11.6f%11.6f%7.1fx%11.6f%7.1fx%11.6f%7.1fx\n",
+	       params.size, "yes", loop_secs, batch_secs, loop_secs / batch_secs,
+	       region_secs, loop_secs / region_secs,
+	       pool_secs, loop_secs / pool_secs);
+    }
+    printf("\n");
+    free(params.ptrs);
+}
+
+/*
+ * check_batch - Fill each of the blocks of a batch with a byte of its
+ *    own and check that they are aligned and all keep their contents
+ */
+static int check_batch(batch_t *params)
+{
+    int i, j;
+    unsigned char *p;
+
+    for (i = 0; i < params->n; i++)
+	memset(params->ptrs[i], i & 0xFF, params->size);
+    for (i = 0; i < params->n; i++) {
+	p = params->ptrs[i];
+	for (j = 0; j < params->size && p[j] == (i & 0xFF); j++)
+	    ;
+	if (!IS_ALIGNED(p) || j < params->size)
+	    return 0;
+    }
+    return 1;
+}
+
+/*
+ * eval_mm_loop_speed, eval_mm_batch_speed, eval_mm_region_speed and
+ *    eval_mm_pool_speed - The timed runs of the batch benchmark, from
+ *    an empty heap
+ */
+static void eval_mm_loop_speed(void *ptr)
+{
+    batch_t *params = (batch_t *)ptr;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_loop_speed");
+    for (i = 0; i < params->n; i++)
+	if ((params->ptrs[i] = mm_malloc(params->size)) == NULL)
+	    app_error("mm_malloc error in eval_mm_loop_speed");
+    for (i = 0; i < params->n; i++)
+	mm_free(params->ptrs[i]);
+}
+
+static void eval_mm_batch_speed(void *ptr)
+{
+    batch_t *params = (batch_t *)ptr;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_mm_batch_speed");
+    if (mm_malloc_batch(params->size, params->n, params->ptrs) != params->n)
+	app_error("mm_malloc_batch error in eval_mm_batch_speed");
+    mm_free_batch(params->ptrs, params->n);
+}
+
+static void eval_mm_region_speed(void *ptr)
+{
+    batch_t *params = (batch_t *)ptr;
+    mm_region_t *r;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0 || (r = mm_region_create()) == NULL)
+	app_error("mm_region_create failed in eval_mm_region_speed");
+    for (i = 0; i < params->n; i++)
+	if ((params->ptrs[i] = mm_region_alloc(r, params->size)) == NULL)
+	    app_error("mm_region_alloc error in eval_mm_region_speed");
+    mm_region_destroy(r);
+}
+
+static void eval_mm_pool_speed(void *ptr)
+{
+    batch_t *params = (batch_t *)ptr;
+    mm_pool_t *pool;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0 || (pool = mm_pool_create(params->size)) == NULL)
+	app_error("mm_pool_create failed in eval_mm_pool_speed");
+    for (i = 0; i < params->n; i++)
+	if ((params->ptrs[i] = mm_pool_alloc(pool)) == NULL)
+	    app_error("mm_pool_alloc error in eval_mm_pool_speed");
+    for (i = 0; i < params->n; i++)
+	mm_pool_free(pool, params->ptrs[i]);
+    mm_pool_destroy(pool);
+}
+
+/*
+ * eval_mm_procs - Replay each valid trace in nprocs processes at once,
+ *    all allocating from and freeing into one heap in shared memory,
+ *    and print their combined throughput. The processes are released
+ *    together, and the time runs until the last one is done. The heap
+ *    may grow to nprocs times the usual maximum.
+ */
+static void eval_mm_procs(int n, char **tracefiles, stats_t *stats,
+			  int nprocs)
+{
+    int i, p, status, valid;
+    int go[2];
+    char c;
+    pid_t pid;
+    struct timespec start, end;
+    double secs;
+    size_t maxheap = mem_maxheap();
+    trace_t *trace;
+
+    printf("Results for %d processes sharing one heap:\n", nprocs);
+    printf("%5s%7s %8s%10s%6s\n", "trace", " valid", "ops", "secs", "Kops");
+    for (i = 0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	mem_deinit();
+	mem_set_maxheap(maxheap * nprocs);
+	mem_init_shared();
+	if (mm_init() < 0)
+	    app_error("mm_init failed in eval_mm_procs");
+
+	/* Each child waits until the parent closes the pipe */
+	if (pipe(go) < 0)
+	    unix_error("pipe failed in eval_mm_procs");
+	fflush(stdout);
+	for (p = 0; p < nprocs; p++) {
+	    if ((pid = fork()) < 0)
+		unix_error("fork failed in eval_mm_procs");
+	    if (pid == 0) {
+		close(go[1]);
+		while (read(go[0], &c, 1) < 0 && errno == EINTR)
+		    ;
+		_exit(eval_mm_shared(trace, p) ? 0 : 1);
+	    }
+	}
+	close(go[0]);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	close(go[1]);
+
+	valid = 1;
+	for (p = 0; p < nprocs; p++)
+	    if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+		valid = 0;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	if (valid)
+	    printf("%2d%10s%9.0f%10.6f%6.0f\n", i, "yes",
+		   (double)nprocs * trace->num_ops, secs,
+		   nprocs * trace->num_ops / 1e3 / secs);
+	else {
+	    errors++;
+	    printf("%2d%10s%9s%10s%6s\n", i, "no", "-", "-", "-");
+	}
+	free_trace(trace);
+    }
+    printf("\n");
+    mem_deinit();
+    mem_set_maxheap(maxheap);
+    mem_init();
+}
+
+/*
+ * eval_mm_shared - Replay the trace as process number id of those
+ *    sharing the heap. The first and last bytes of each payload are
+ *    stamped with a pattern of the process and block, and checked
+ *    before the block is freed or resized, so that a block handed
+ *    to two processes at once is caught. Returns 1 if all is well.
+ */
+static int eval_mm_shared(trace_t *trace, int id)
+{
+    int i, index, size, oldsize;
+    unsigned char tag;
+    char *p;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	tag = (unsigned char)(id * 31 + index);
+	switch (trace->ops[i].type) {
+
+	case ALLOC: /* mm_malloc */
+	case MEMALIGN: /* mm_memalign */
+	case CALLOC: /* mm_calloc */
+	    size = trace->ops[i].size;
+	    if ((p = mm_alloc_op(&trace->ops[i])) == NULL)
+		return 0;
+	    p[0] = p[size - 1] = tag;
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    size = trace->ops[i].size;
+	    oldsize = trace->block_sizes[index];
+	    p = trace->blocks[index];
+	    if ((unsigned char)p[0] != tag || (unsigned char)p[oldsize - 1] != tag)
+		return 0;
+	    if ((p = mm_realloc(p, size)) == NULL || (unsigned char)p[0] != tag)
+		return 0;
+	    p[size - 1] = tag;
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+	case FREE: /* mm_free */
+	    p = trace->blocks[index];
+	    size = trace->block_sizes[index];
+	    if ((unsigned char)p[0] != tag || (unsigned char)p[size - 1] != tag)
+		return 0;
+	    mm_free(p);
+	    break;
+
+	default:
+	    return 0;
+	}
+    }
+    return 1;
+}
+
 /* 
  * eval_libc_speed - This is the function that is used by fcyc() to
  *    measure the running time of the libc malloc package on the set
@@ -891,6 +1563,14 @@ static void eval_libc_speed(void *ptr)
 	    trace->blocks[index] = p;
 	    break;
 
+        case MEMALIGN: /* posix_memalign */
+        case CALLOC: /* calloc */
+	    index = trace->ops[i].index;
+	    if ((p = libc_alloc_op(&trace->ops[i])) == NULL)
+		unix_error("posix_memalign or calloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
 	case REALLOC: /* realloc */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
@@ -914,62 +1594,189 @@ static void eval_libc_speed(void *ptr)
  * Some miscellaneous helper routines
  ************************************/
 
+/*
+ * mm_alloc_op - Call mm_malloc, mm_memalign or mm_calloc for an ALLOC,
+ *     MEMALIGN or CALLOC request, and return the new block
+ */
+static char *mm_alloc_op(traceop_t *op)
+{
+    if (op->type == MEMALIGN)
+	return mm_memalign(op->align, op->size);
+    if (op->type == CALLOC)
+	return mm_calloc(1, op->size);
+    if (use_hints && op->hint != MM_HINT_NONE)
+	return mm_malloc_hint(op->size, op->hint);
+    return mm_malloc(op->size);
+}
+
+/*
+ * oracle_hints - Give every allocation in the trace that has no hint
+ *     the one its actual lifetime calls for: short if it is freed or
+ *     resized within short_ops requests, permanent if never, and long
+ *     otherwise. Returns the number of allocations hinted.
+ */
+static int oracle_hints(trace_t *trace, int short_ops)
+{
+    int i, n = 0;
+    int *next;    /* per id, the next request that frees or resizes it */
+    traceop_t *op;
+
+    if ((next = malloc(trace->num_ids * sizeof(int))) == NULL)
+	unix_error("malloc error in oracle_hints");
+    for (i = 0; i < trace->num_ids; i++)
+	next[i] = -1;
+
+    for (i = trace->num_ops - 1; i >= 0; i--) {
+	op = &trace->ops[i];
+	if (op->type == FREE || op->type == REALLOC) {
+	    next[op->index] = i;
+	    continue;
+	}
+	if (op->hint == MM_HINT_NONE) {
+	    op->hint = (next[op->index] < 0) ? MM_HINT_PERMANENT :
+		(next[op->index] - i <= short_ops) ? MM_HINT_SHORT :
+		MM_HINT_LONG;
+	    n++;
+	}
+	next[op->index] = -1;
+    }
+    free(next);
+    return n;
+}
 
 /*
- * printresults - prints a performance summary for some malloc package
+ * libc_alloc_op - The same for libc malloc, posix_memalign and calloc
  */
-static void printresults(int n, stats_t *stats) 
+static char *libc_alloc_op(traceop_t *op)
+{
+    void *p;
+
+    if (op->type == MEMALIGN)
+	return posix_memalign(&p, (op->align < sizeof(void *)) ?
+			      sizeof(void *) : op->align, op->size) ? NULL : p;
+    if (op->type == CALLOC)
+	return calloc(1, op->size);
+    return malloc(op->size);
+}
+
+
+/*
+ * printresults - prints a performance summary for some malloc package,
+ *     with the resident-set util and faults per 1000 ops if rss is set,
+ *     and the calloc bytes that were known to be zero if there were any
+ */
+static void printresults(int n, stats_t *stats, int rss) 
 {
     int i;
     double secs = 0;
     double ops = 0;
     double util = 0;
+    double rss_util = 0;
+    double faults = 0;
+    double calloc_bytes = 0;
+    double calloc_zero = 0;
+    double hint_util = 0, nohint_util = 0;
+    double compact_util = 0, pointer_util = 0;
+    double fit_searches = 0, fit_blocks = 0, fit_bytes = 0;
+    int hinted = 0, compacted = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
+    printf("%5s%7s %5s%8s%10s%6s", 
 	   "trace", " valid", "util", "ops", "secs", "Kops");
+    if (rss)
+	printf("%6s%8s", "rss", "flt/K");
+    printf("\n");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
 		   (stats[i].ops/1e3)/stats[i].secs);
+	    if (rss)
+		printf("%5.0f%%%8.1f", stats[i].rss_util*100.0, stats[i].faults);
+	    printf("\n");
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
+	    rss_util += stats[i].rss_util;
+	    faults += stats[i].faults * stats[i].ops / 1e3;
+	    calloc_bytes += stats[i].calloc_bytes;
+	    calloc_zero += stats[i].calloc_zero;
+	    fit_searches += stats[i].fit_searches;
+	    fit_blocks += stats[i].fit_blocks;
+	    fit_bytes += stats[i].fit_bytes;
+	    if (stats[i].util_compact > 0) {
+		compact_util += stats[i].util_compact;
+		pointer_util += stats[i].util;
+		compacted++;
+	    }
+	    if (stats[i].util_nohint > 0) {
+		hint_util += stats[i].util;
+		nohint_util += stats[i].util_nohint;
+		hinted++;
+	    }
 	}
 	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
+	    printf("%2d%10s%6s%8s%10s%6s", 
 		   i,
 		   "no",
 		   "-",
 		   "-",
 		   "-",
 		   "-");
+	    if (rss)
+		printf("%6s%8s", "-", "-");
+	    printf("\n");
 	}
     }
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	printf("%12s%5.0f%%%8.0f%10.6f%6.0f", 
 	       "Total       ",
 	       (util/n)*100.0,
 	       ops, 
 	       secs,
 	       (ops/1e3)/secs);
+	if (rss)
+	    printf("%5.0f%%%8.1f", (rss_util/n)*100.0, 1e3*faults/ops);
+	printf("\n");
     }
     else {
-	printf("%12s%6s%8s%10s%6s\n", 
+	printf("%12s%6s%8s%10s%6s", 
 	       "Total       ",
 	       "-", 
 	       "-", 
 	       "-", 
 	       "-");
+	if (rss)
+	    printf("%6s%8s", "-", "-");
+	printf("\n");
     }
 
+    /* Print how much calloc'd memory was already known to be zero */
+    if (calloc_bytes > 0)
+	printf("calloc: %.0f of %.0f bytes (%.0f%%) known zero, not cleared\n",
+	       calloc_zero, calloc_bytes, 100.0 * calloc_zero / calloc_bytes);
+
+    /* Print how far find_fit walked through the large free blocks */
+    if (fit_searches > 0 && fit_blocks > 0)
+	printf("fit: %.1f large blocks scanned per search, %.0f bytes apart\n",
+	       fit_blocks / fit_searches, fit_bytes / fit_blocks);
+
+    /* Print what the lifetime hints did for util */
+    if (hinted > 0)
+	printf("hints: util %.0f%% with lifetime hints, %.0f%% without (%d traces)\n",
+	       100.0 * hint_util / hinted, 100.0 * nohint_util / hinted, hinted);
+
+    /* Print the util of the same traces run on compacted handles */
+    if (compacted > 0)
+	printf("compact: util %.0f%% on handles with mm_compact, %.0f%% on pointers (%d traces)\n",
+	       100.0 * compact_util / compacted, 100.0 * pointer_util / compacted,
+	       compacted);
 }
 
 /* 
@@ -1004,14 +1811,27 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValAHR] [-f <file>] [-t <dir>] [-M <mb>] [-T <bytes>] [-D <ops>] [-w <pct>] [-P <n>] [-B <n>] [-L <ops>] [-C <ops>] [-S <bytes>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-A         Keep large free blocks in address order.\n");
+    fprintf(stderr, "\t-B <n>     Time batches, regions and pools of <n> blocks against single calls.\n");
+    fprintf(stderr, "\t-C <ops>   Rerun the traces on handles, calling mm_compact every <ops> requests.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Compare dTLB misses on 4 KB and 2 MB huge pages.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L <ops>   Hint allocations freed within <ops> requests as short-lived.\n");
+    fprintf(stderr, "\t-P <n>     Also run the traces in <n> processes sharing one heap.\n");
+    fprintf(stderr, "\t-R         Report resident-set util and page faults per 1000 ops.\n");
+    fprintf(stderr, "\t-M <mb>    Allow the heap to grow to <mb> MB (default %d).\n",
+	    MAX_HEAP >> 20);
+    fprintf(stderr, "\t-S <bytes> Cut blocks of at least <bytes> from the end of free blocks.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <bytes> Give requests of at least <bytes> their own mapping.\n");
+    fprintf(stderr, "\t-D <ops>   Purge free blocks idle for a full epoch of <ops> requests (0 = never).\n");
+    fprintf(stderr, "\t-w <pct>   Time each trace from a heap aged by its first <pct>%% of requests.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
@@ -2,7 +2,25 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ * Besides the sbrk-style heap, it hands out direct mappings (mem_map)
+ * for large objects that should live outside the heap. The footprint
+ * of the package is the heap plus the mapped bytes, and mem_footprint
+ * reports its peak.
+ *
+ * The heap can also be snapshotted and restored copy-on-write, so that
+ * repeated runs can all start from the same aged heap.
+ *
+ * Instead of anonymous memory, the heap can be a shared mapping of a
+ * file (mem_init_file), which keeps the heap from one run of a
+ * program to the next, or of a memory file (mem_init_shared), which
+ * processes forked afterwards share. The first page of the file is a
+ * header that holds the break; the heap follows it. Since any process
+ * sharing the heap can move the break, the header is the master copy
+ * and mem_brk just caches it. The package must serialize its calls
+ * to mem_sbrk across the processes.
  */
+#define _GNU_SOURCE  /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,64 +28,569 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* Committed memory grows by at least this many bytes at a time */
+#define COMMIT_MIN (64*1024)
+
+/* Size of a transparent huge page, and the commit unit in huge mode */
+#define HUGE_PAGE (2*1024*1024)
+
+/* Marks the header page of a heap file */
+#define MEM_FILE_MAGIC 0x6d656d31
+
+/* Pages whose residency mem_resident asks mincore about at a time */
+#define MINCORE_PAGES 4096
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_commit_brk; /* end of the read/write part of the reservation */
+static char *mem_zero_start; /* the heap reads as zeros from here up */
+static size_t mem_max_heap = MAX_HEAP; /* size of the reservation */
+static int mem_huge;         /* back the heap with transparent huge pages */
+
+/* Header that memlib puts in front of each direct mapping */
+typedef struct mem_map_s {
+    struct mem_map_s *next;  /* circular list of live mappings */
+    struct mem_map_s *prev;
+    size_t len;              /* length of the whole mapping */
+    char pad[64 - 2*sizeof(void *) - sizeof(size_t)]; /* caller's area is
+                                cache-line aligned, for any ALIGNMENT */
+} mem_map_t;
+
+/* Header in the first page of a heap file */
+typedef struct {
+    unsigned int magic;      /* MEM_FILE_MAGIC */
+    size_t brk;              /* size of the heap */
+    size_t commit;           /* bytes of heap in the file */
+    size_t zero;             /* bytes of heap before the zeros start */
+} mem_file_t;
+
+static mem_file_t *mem_file; /* header of the heap file, or NULL */
+static int mem_fd = -1;      /* the heap file, or -1 */
+
+static mem_map_t mem_maps = {&mem_maps, &mem_maps, 0}; /* list head */
+static size_t mem_mapped;    /* bytes in live mappings */
+static size_t mem_peak;      /* peak of heap plus mapped bytes */
+
+static int mem_snap_fd = -1; /* memfd holding the committed heap, or -1 */
+static size_t mem_snap_brk;  /* heap size when the snapshot was taken */
+static size_t mem_snap_len;  /* committed bytes when it was taken */
+static size_t mem_snap_peak; /* footprint peak when it was taken */
+static char *mem_snap_end;   /* end of the snapshot mem_restore mapped over
+				the heap; purged pages below it read back
+				as the snapshot */
+
+static void mem_update_peak(void);
+static void mem_decommit(char *lo);
+static void mem_init_fd(int fd, void *base, const char *name);
+static void mem_file_sync(void);
+static size_t mem_resident_range(char *lo, size_t len);
+
+/*
+ * mem_set_maxheap - set the largest heap that mem_init will reserve.
+ *    Must be called before mem_init.
+ */
+void mem_set_maxheap(size_t maxheap)
+{
+    mem_max_heap = maxheap;
+}
+
+/*
+ * mem_set_hugepages - if on is nonzero, have mem_init place the heap
+ *    on transparent huge pages. Must be called before mem_init.
+ */
+void mem_set_hugepages(int on)
+{
+    mem_huge = on;
+}
 
 /* 
- * mem_init - initialize the memory system model
+ * mem_init - initialize the memory system model. The whole maximum
+ *    heap is reserved as an inaccessible anonymous mapping, and pages
+ *    are made accessible (committed) only as the break passes them,
+ *    so startup costs the same for any maximum heap size.
+ *
+ *    In huge page mode the reservation is aligned to HUGE_PAGE and
+ *    marked MADV_HUGEPAGE, and mem_sbrk commits whole huge pages, so
+ *    the kernel can back every committed extent with huge pages.
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    char *p, *start;
+    size_t unit = mem_huge ? HUGE_PAGE : mem_pagesize();
+    size_t slack = mem_huge ? HUGE_PAGE : 0;
+
+    mem_max_heap = (mem_max_heap + unit - 1) & ~(unit - 1);
+    p = mmap(NULL, mem_max_heap + slack, PROT_NONE,
+	     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
+	exit(1);
+    }
+
+    /* Trim the reservation to an aligned range of mem_max_heap bytes */
+    start = (char *)(((unsigned long)p + unit - 1) & ~(unsigned long)(unit - 1));
+    if (start > p)
+	munmap(p, start - p);
+    if (p + slack > start)
+	munmap(start + mem_max_heap, p + slack - start);
+#ifdef MADV_HUGEPAGE
+    if (mem_huge && madvise(start, mem_max_heap, MADV_HUGEPAGE) < 0)
+	fprintf(stderr, "mem_init_vm: transparent huge pages not available\n");
+#endif
+
+    mem_start_brk = start;
+    mem_max_addr = mem_start_brk + mem_max_heap;  /* max legal heap address */
+    mem_brk = mem_start_brk;                      /* heap is empty initially */
+    mem_commit_brk = mem_start_brk;               /* nothing committed yet */
+    mem_zero_start = mem_start_brk;               /* nothing written yet */
+    mem_snap_end = mem_start_brk;                 /* no snapshot mapped */
+}
+
+/*
+ * mem_init_file - initialize the memory system model with the heap in
+ *    the file path, creating it if it does not exist. A heap left in
+ *    the file by an earlier run comes back as it was, with the same
+ *    break. The heap is placed at base if that is not NULL, and
+ *    anywhere otherwise. The reservation is the maximum heap or the
+ *    heap in the file, whichever is larger, and the file grows as the
+ *    break does. There are no direct mappings in this mode.
+ */
+void mem_init_file(const char *path, void *base)
+{
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0) {
+	fprintf(stderr, "mem_init_file: cannot open %s\n", path);
+	exit(1);
+    }
+    mem_init_fd(fd, base, path);
+}
+
+/*
+ * mem_init_shared - initialize the memory system model with the heap in
+ *    a new memory file, so that processes forked from now on share the
+ *    heap rather than getting copies of it. Like a heap file, it has
+ *    no direct mappings.
+ */
+void mem_init_shared(void)
+{
+    int fd;
+
+    if ((fd = memfd_create("memlib-heap", 0)) < 0) {
+	fprintf(stderr, "mem_init_shared: memfd_create error\n");
+	exit(1);
+    }
+    mem_init_fd(fd, NULL, "shared heap");
+}
+
+/*
+ * mem_init_fd - map the heap file fd, named name in error messages,
+ *    for mem_init_file and mem_init_shared
+ */
+static void mem_init_fd(int fd, void *base, const char *name)
+{
+    struct stat st;
+    size_t pg = mem_pagesize(), len;
+    int flags = MAP_SHARED;
+    char *p;
+
+    mem_fd = fd;
+    if (fstat(mem_fd, &st) < 0 ||
+	(st.st_size == 0 && ftruncate(mem_fd, pg) < 0)) {
+	fprintf(stderr, "mem_init_file: cannot grow %s\n", name);
 	exit(1);
     }
+    len = (st.st_size > (off_t)pg) ? st.st_size - pg : 0;
+    mem_max_heap = (mem_max_heap + pg - 1) & ~(pg - 1);
+    if (len > mem_max_heap)
+	mem_max_heap = len;
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    /* Map the header page and the whole reservation, the part past the
+       end of the file being committed by growing the file */
+#ifdef MAP_FIXED_NOREPLACE
+    if (base != NULL)
+	flags |= MAP_FIXED_NOREPLACE;
+#endif
+    p = mmap(base ? (char *)base - pg : NULL, pg + mem_max_heap,
+	     PROT_READ | PROT_WRITE, flags, mem_fd, 0);
+    if (p == MAP_FAILED || (base != NULL && p + pg != base)) {
+	fprintf(stderr, "mem_init_file: cannot map %s\n", name);
+	exit(1);
+    }
+
+    mem_file = (mem_file_t *)p;
+    if (st.st_size == 0) {
+	mem_file->magic = MEM_FILE_MAGIC;
+	mem_file->brk = 0;
+    }
+    else if (mem_file->magic != MEM_FILE_MAGIC || mem_file->brk > len) {
+	fprintf(stderr, "mem_init_file: %s is not a heap file\n", name);
+	exit(1);
+    }
+    mem_file->commit = len;
+    mem_file->zero = len; /* anything in the file may have been written */
+
+    mem_start_brk = p + pg;
+    mem_max_addr = mem_start_brk + mem_max_heap;
+    mem_snap_end = mem_start_brk;
+    mem_file_sync();
 }
 
 /* 
- * mem_deinit - free the storage used by the memory system model
+ * mem_deinit - free the storage used by the memory system model. A
+ *    heap file keeps the heap for the next mem_init_file, and a shared
+ *    heap lasts until every process sharing it is done with it.
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    if (mem_file != NULL) {
+	munmap(mem_file, mem_pagesize() + mem_max_heap);
+	close(mem_fd);
+	mem_file = NULL;
+	mem_fd = -1;
+    }
+    else {
+	mem_reset_brk();
+	munmap(mem_start_brk, mem_max_heap);
+    }
+    mem_start_brk = mem_brk = mem_max_addr = mem_commit_brk = NULL;
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *    and remove all direct mappings
  */
 void mem_reset_brk()
 {
+    while (mem_maps.next != &mem_maps)
+	mem_unmap(mem_maps.next + 1);
     mem_brk = mem_start_brk;
+    mem_peak = 0;
+    if (mem_file != NULL)
+	mem_file->brk = 0;
+}
+
+/*
+ * mem_reset_heap - like mem_reset_brk, but also give back the committed
+ *    pages of an anonymous heap, so that it reads as zeros again, as a
+ *    new process's heap would
+ */
+void mem_reset_heap(void)
+{
+    if (mem_file == NULL)
+	mem_decommit(mem_start_brk);
+    mem_reset_brk();
+}
+
+/*
+ * mem_snapshot - save a copy of the heap in a memory file, to be put
+ *    back later by mem_restore. Returns 0 on success, or -1 if it
+ *    fails, if there are direct mappings, which are not saved, or if
+ *    the heap lives in a file.
+ *    The package's state must live in the heap for the copy to be a
+ *    complete one.
+ */
+int mem_snapshot(void)
+{
+    size_t len = mem_commit_brk - mem_start_brk, done = 0;
+    ssize_t n;
+    int fd;
+
+    if (mem_file != NULL || mem_maps.next != &mem_maps)
+	return -1;
+    if ((fd = memfd_create("memlib-snapshot", 0)) < 0)
+	return -1;
+    if (ftruncate(fd, len) < 0) {
+	close(fd);
+	return -1;
+    }
+    while (done < len) {
+	if ((n = write(fd, mem_start_brk + done, len - done)) <= 0) {
+	    close(fd);
+	    return -1;
+	}
+	done += n;
+    }
+
+    if (mem_snap_fd >= 0)
+	close(mem_snap_fd);
+    mem_snap_fd = fd;
+    mem_snap_brk = mem_brk - mem_start_brk;
+    mem_snap_len = len;
+    mem_snap_peak = mem_peak;
+    return 0;
+}
+
+/*
+ * mem_restore - put the heap back the way it was at the last
+ *    mem_snapshot, removing all direct mappings. The snapshot is
+ *    mapped privately over the heap, so restoring costs no copying;
+ *    pages are read in when touched and copied when first written.
+ *    Until mem_snapshot_drop, pages released by mem_purge read back
+ *    as their snapshot contents rather than as zeros.
+ */
+void mem_restore(void)
+{
+    while (mem_maps.next != &mem_maps)
+	mem_unmap(mem_maps.next + 1);
+    if (mem_commit_brk > mem_start_brk + mem_snap_len)
+	mem_decommit(mem_start_brk + mem_snap_len);
+    if (mem_snap_len > 0 &&
+	mmap(mem_start_brk, mem_snap_len, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_FIXED, mem_snap_fd, 0) == MAP_FAILED) {
+	fprintf(stderr, "mem_restore: mmap error\n");
+	exit(1);
+    }
+    mem_commit_brk = mem_start_brk + mem_snap_len;
+    mem_zero_start = mem_commit_brk;
+    mem_snap_end = mem_commit_brk;
+    mem_brk = mem_start_brk + mem_snap_brk;
+    mem_peak = mem_snap_peak;
+}
+
+/*
+ * mem_snapshot_drop - discard the snapshot, and return to an empty heap
+ *    of anonymous memory
+ */
+void mem_snapshot_drop(void)
+{
+    if (mem_snap_fd < 0)
+	return;
+    close(mem_snap_fd);
+    mem_snap_fd = -1;
+    mem_reset_heap();
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.
+ *    mem_trim shrinks it again.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(size_t incr) 
 {
-    char *old_brk = mem_brk;
+    char *old_brk;
+    size_t len, unit;
+
+    mem_file_sync();
+    old_brk = mem_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if (incr > (size_t)(mem_max_addr - mem_brk)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
+
+    /* Commit the pages the new break reaches, COMMIT_MIN (or a huge
+       page) at a time */
+    if (mem_brk + incr > mem_commit_brk) {
+	unit = mem_huge ? HUGE_PAGE : mem_pagesize();
+	len = mem_brk + incr - mem_commit_brk;
+	len = (len < COMMIT_MIN) ? COMMIT_MIN : len;
+	len = (len + unit - 1) & ~(unit - 1);
+	if (len > (size_t)(mem_max_addr - mem_commit_brk))
+	    len = mem_max_addr - mem_commit_brk;
+	if (mem_file != NULL ?
+	    ftruncate(mem_fd, (char *)mem_commit_brk + len - (char *)mem_file) < 0 :
+	    mprotect(mem_commit_brk, len, PROT_READ | PROT_WRITE) < 0) {
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit memory...\n");
+	    return (void *)-1;
+	}
+	mem_commit_brk += len;
+    }
     mem_brk += incr;
+    if (mem_brk > mem_zero_start)
+	mem_zero_start = mem_brk;
+    if (mem_file != NULL) {
+	mem_file->brk = mem_brk - mem_start_brk;
+	mem_file->commit = mem_commit_brk - mem_start_brk;
+	mem_file->zero = mem_zero_start - mem_start_brk;
+    }
+    mem_update_peak();
     return (void *)old_brk;
 }
 
+/*
+ * mem_trim - shrink the heap by decr bytes, and give the whole pages
+ *    past the new break back to the system, as mem_purge does
+ */
+void mem_trim(size_t decr)
+{
+    mem_file_sync();
+    if (decr > (size_t)(mem_brk - mem_start_brk))
+	decr = mem_brk - mem_start_brk;
+    mem_brk -= decr;
+    if (mem_file != NULL)
+	mem_file->brk = mem_brk - mem_start_brk;
+    mem_purge(mem_brk, mem_commit_brk - mem_brk);
+}
+
+/*
+ * mem_purge - give the whole pages inside the len bytes at lo back to
+ *    the system. They stay part of the heap and read as zeros when
+ *    next touched, unless they lie below mem_purge_zero_lo. Returns
+ *    the number of bytes released. The pages of a heap file are
+ *    punched out of the file with MADV_REMOVE, since MADV_DONTNEED
+ *    would only drop them from this process's mapping.
+ */
+size_t mem_purge(void *lo, size_t len)
+{
+    size_t pg = mem_pagesize();
+    char *start = (char *)(((unsigned long)lo + pg - 1) & ~(unsigned long)(pg - 1));
+    char *end = (char *)(((unsigned long)lo + len) & ~(unsigned long)(pg - 1));
+    char *zero = (start > mem_snap_end) ? start : mem_snap_end;
+
+    if (end <= start ||
+	madvise(start, end - start, mem_file ? MADV_REMOVE : MADV_DONTNEED) < 0)
+	return 0;
+    mem_file_sync();
+    if (zero <= mem_zero_start && mem_zero_start <= end) {
+	mem_zero_start = zero;
+	if (mem_file != NULL)
+	    mem_file->zero = mem_zero_start - mem_start_brk;
+    }
+    return end - start;
+}
+
+/*
+ * mem_map - map a region of at least size bytes outside the heap and
+ *    return its start, or NULL if the system is out of memory or the
+ *    heap lives in a file, where a mapping would not last. The
+ *    start is 64-byte aligned and the region is zero-filled.
+ */
+void *mem_map(size_t size)
+{
+    mem_map_t *m;
+    size_t len;
+
+    if (mem_file != NULL || size > (size_t)-1 - sizeof(mem_map_t) - mem_pagesize())
+	return NULL;
+    len = (sizeof(mem_map_t) + size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    m = mmap(NULL, len, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED)
+	return NULL;
+
+    m->len = len;
+    m->next = mem_maps.next;
+    m->prev = &mem_maps;
+    mem_maps.next->prev = m;
+    mem_maps.next = m;
+    mem_mapped += len;
+    mem_update_peak();
+    return (void *)(m + 1);
+}
+
+/*
+ * mem_remap - resize the region p returned by mem_map to at least size
+ *    bytes, moving it if needed, and return its new start. The contents
+ *    are kept up to the lesser of the two sizes. Returns NULL, leaving
+ *    the old region in place, if the system is out of memory.
+ */
+void *mem_remap(void *p, size_t size)
+{
+    mem_map_t *m = (mem_map_t *)p - 1;
+    size_t len, oldlen = m->len;
+
+    if (size > (size_t)-1 - sizeof(mem_map_t) - mem_pagesize())
+	return NULL;
+    len = (sizeof(mem_map_t) + size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    if (len == oldlen)
+	return p;
+    m = mremap(m, oldlen, len, MREMAP_MAYMOVE);
+    if (m == MAP_FAILED)
+	return NULL;
+
+    /* The mapping may have moved, so repair its neighbors' links */
+    m->len = len;
+    m->next->prev = m;
+    m->prev->next = m;
+    mem_mapped += len - oldlen;
+    mem_update_peak();
+    return (void *)(m + 1);
+}
+
+/*
+ * mem_unmap - remove the region p returned by mem_map or mem_remap
+ */
+void mem_unmap(void *p)
+{
+    mem_map_t *m = (mem_map_t *)p - 1;
+
+    m->next->prev = m->prev;
+    m->prev->next = m->next;
+    mem_mapped -= m->len;
+    munmap(m, m->len);
+}
+
+/*
+ * mem_map_size - return the usable size of the region p returned by
+ *    mem_map or mem_remap, which may exceed the size asked for
+ */
+size_t mem_map_size(void *p)
+{
+    return ((mem_map_t *)p - 1)->len - sizeof(mem_map_t);
+}
+
+/*
+ * mem_is_mapped - return 1 if the size bytes at lo lie inside a single
+ *    live region from mem_map, 0 otherwise
+ */
+int mem_is_mapped(void *lo, size_t size)
+{
+    mem_map_t *m;
+    char *start, *end;
+
+    for (m = mem_maps.next; m != &mem_maps; m = m->next) {
+	start = (char *)(m + 1);
+	end = (char *)m + m->len;
+	if ((char *)lo >= start && (char *)lo < end)
+	    return size <= (size_t)(end - (char *)lo);
+    }
+    return 0;
+}
+
+/*
+ * mem_footprint - return the peak number of bytes in the heap and in
+ *    direct mappings together, since the last mem_reset_brk
+ */
+size_t mem_footprint()
+{
+    return mem_peak;
+}
+
+/*
+ * mem_resident - return the number of bytes of the committed heap and
+ *    the direct mappings that are currently backed by physical pages
+ */
+size_t mem_resident()
+{
+    mem_map_t *m;
+    size_t bytes;
+
+    mem_file_sync();
+    bytes = mem_resident_range(mem_start_brk, mem_commit_brk - mem_start_brk);
+    for (m = mem_maps.next; m != &mem_maps; m = m->next)
+	bytes += mem_resident_range((char *)m, m->len);
+    return bytes;
+}
+
+/*
+ * mem_is_shared - return 1 if the heap is a shared mapping of a file,
+ *    which other processes may be using too, and 0 otherwise
+ */
+int mem_is_shared()
+{
+    return mem_file != NULL;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -81,14 +604,46 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
+    mem_file_sync();
     return (void *)(mem_brk - 1);
 }
 
+/*
+ * mem_zero_lo - returns the lowest heap address from which the heap
+ *    reads as zeros: nothing above it has been written since it was
+ *    committed or purged, so memory that mem_sbrk returns from there
+ *    up need not be cleared
+ */
+void *mem_zero_lo()
+{
+    mem_file_sync();
+    return (void *)mem_zero_start;
+}
+
+/*
+ * mem_purge_zero_lo - returns the lowest heap address from which pages
+ *    released by mem_purge read as zeros. Below it lies the snapshot
+ *    that mem_restore mapped over the heap, which they read back as.
+ */
+void *mem_purge_zero_lo()
+{
+    return (void *)mem_snap_end;
+}
+
+/*
+ * mem_maxheap() - returns the largest heap size in bytes
+ */
+size_t mem_maxheap()
+{
+    return mem_max_heap;
+}
+
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
 size_t mem_heapsize() 
 {
+    mem_file_sync();
     return (size_t)(mem_brk - mem_start_brk);
 }
 
@@ -99,3 +654,79 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_update_peak - fold the current footprint into the peak
+ */
+static void mem_update_peak(void)
+{
+    size_t now = mem_heapsize() + mem_mapped;
+
+    if (now > mem_peak)
+	mem_peak = now;
+}
+
+/*
+ * mem_resident_range - count the resident bytes in the page-aligned
+ *    len bytes at lo, asking mincore about MINCORE_PAGES at a time
+ */
+static size_t mem_resident_range(char *lo, size_t len)
+{
+    static unsigned char vec[MINCORE_PAGES];
+    size_t pg = mem_pagesize();
+    size_t i, n, bytes = 0;
+
+    while (len > 0) {
+	n = (len + pg - 1) / pg;
+	n = (n > MINCORE_PAGES) ? MINCORE_PAGES : n;
+	if (mincore(lo, n * pg, vec) < 0) {
+	    fprintf(stderr, "mem_resident: mincore error\n");
+	    exit(1);
+	}
+	for (i = 0; i < n; i++)
+	    if (vec[i] & 1)
+		bytes += pg;
+	lo += n * pg;
+	len = (len > n * pg) ? len - n * pg : 0;
+    }
+    return bytes;
+}
+
+/*
+ * mem_decommit - replace the committed heap from lo up with fresh
+ *    inaccessible reservation, as if the break had never passed lo
+ */
+static void mem_decommit(char *lo)
+{
+    if (lo >= mem_commit_brk)
+	return;
+    if (mmap(lo, mem_commit_brk - lo, PROT_NONE,
+	     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+	     -1, 0) == MAP_FAILED) {
+	fprintf(stderr, "mem_decommit: mmap error\n");
+	exit(1);
+    }
+#ifdef MADV_HUGEPAGE
+    if (mem_huge)
+	madvise(lo, mem_commit_brk - lo, MADV_HUGEPAGE);
+#endif
+    mem_commit_brk = lo;
+    if (mem_zero_start > lo)
+	mem_zero_start = lo;
+    if (mem_snap_end > lo)
+	mem_snap_end = lo;
+}
+
+/*
+ * mem_file_sync - load mem_brk, mem_commit_brk and mem_zero_start from
+ *    the header of the heap file, where other processes may have moved
+ *    them
+ */
+static void mem_file_sync(void)
+{
+    if (mem_file != NULL) {
+	mem_brk = mem_start_brk + mem_file->brk;
+	mem_commit_brk = mem_start_brk + mem_file->commit;
+	mem_zero_start = mem_start_brk + mem_file->zero;
+    }
+}
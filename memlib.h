@@ -1,11 +1,32 @@
 #include <unistd.h>
 
+void mem_set_maxheap(size_t maxheap);
+void mem_set_hugepages(int on);
 void mem_init(void);               
+void mem_init_file(const char *path, void *base);
+void mem_init_shared(void);
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(size_t incr);
+void mem_trim(size_t decr);
+int mem_snapshot(void);
+void mem_restore(void);
+void mem_snapshot_drop(void);
+size_t mem_purge(void *lo, size_t len);
+void *mem_map(size_t size);
+void *mem_remap(void *p, size_t size);
+void mem_unmap(void *p);
+size_t mem_map_size(void *p);
+int mem_is_mapped(void *lo, size_t size);
+size_t mem_footprint(void);
+size_t mem_resident(void);
+int mem_is_shared(void);
 void mem_reset_brk(void); 
+void mem_reset_heap(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_zero_lo(void);
+void *mem_purge_zero_lo(void);
+size_t mem_maxheap(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
 
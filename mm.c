@@ -14,9 +14,25 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
+
+/* Size classes generated by mmbins for the payload alignment */
+#if ALIGNMENT == 8
+#include "mm_sizeclass8.h"
+#elif ALIGNMENT == 16
+#include "mm_sizeclass16.h"
+#elif ALIGNMENT == 32
+#include "mm_sizeclass32.h"
+#elif ALIGNMENT == 64
+#include "mm_sizeclass64.h"
+#else
+#error "ALIGNMENT must be 8, 16, 32 or 64"
+#endif
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -46,113 +62,1209 @@ team_t team = {
 #define WSIZE       4       /* word size (bytes) */  
 #define DSIZE       8       /* doubleword size (bytes) */
 #define CHUNKSIZE  16  /* initial heap size (bytes) */
-#define OVERHEAD    24       /* overhead of header and footer (bytes) */
+#define HINT_CHUNKSIZE (4*1024) /* heap extension for hinted requests,
+                                   whose two ends they fill (bytes) */
+#define OVERHEAD    MAX(16, ALIGNMENT) /* minimum block: header, two links,
+                                        footer, rounded to ALIGNMENT (bytes) */
+#define MMAP_THRESHOLD (128*1024) /* default size served by mem_map (bytes) */
+#define PURGE_DECAY  8192   /* default length of a purge epoch (requests) */
+#define MAX_OFFSET ((size_t)1 << 32) /* heap offsets must fit in a word */
+#define REGION_CHUNK (8*1024) /* payload of a region chunk (bytes) */
+#define REGION_HDR  ALIGNMENT /* chunk link, padded to keep alignment (bytes) */
+#define SLAB_SIZE   4096    /* size and alignment of a pool slab (bytes) */
+#define SLAB_MAX_OBJ (SLAB_SIZE/8) /* largest object kept in slabs (bytes) */
+
+#define MAX(x, y) ((x) > (y)? (x) : (y))  
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Pack a size and allocated bit into a word */
+#define PACK(size, alloc)  ((size) | (alloc))
+#define MMAPPED     0x2     /* header bit of blocks with their own mapping */
+#define ZEROED      0x2     /* tag bit of free blocks known to be zero, apart
+                               from their tags and free list links */
+#define PURGED      0x4     /* tag bit of free blocks whose interior pages were
+                               released; those above mem_purge_zero_lo are
+                               zero */
+#define HANDLE      0x4     /* header bit of blocks that a handle refers to */
+
+/* Read and write a word at address p */
+#define GET(p)       (*(unsigned int *)(p))
+#define PUT(p, val)  (*(unsigned int *)(p) = (val))  
+
+/* Read the size and allocated fields from address p */
+#define GET_SIZE(p)  (GET(p) & ~0x7)
+#define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_MMAPPED(p) (GET(p) & MMAPPED)
+#define GET_ZEROED(p)  (GET(p) & ZEROED)  /* free blocks only */
+#define GET_PURGED(p)  (GET(p) & PURGED)
+#define GET_HANDLE(p)  (GET(p) & HANDLE)  /* allocated blocks only */
+
+/* Given block ptr bp, compute address of its header and footer */
+#define HDRP(bp)  ((void *)(bp) - WSIZE)                                                    
+#define FTRP(bp)  ((void *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)       
+
+/* Convert between pointers into the heap and word-sized heap offsets,
+   0 being NULL */
+#define TO_OFF(p)    ((p) ? (unsigned int)((char *)(p) - (char *)ctl) : 0)
+#define TO_PTR(off)  ((off) ? (char *)ctl + (off) : NULL)
+
+/* Given free block ptr bp, read and write its free list links. They
+   are heap offsets, so that they take a word on any machine and the
+   heap can be mapped at any address. */
+#define NEXT_LINK(bp)  (*(unsigned int *)((char *)(bp) + WSIZE))
+#define PREV_LINK(bp)  (*(unsigned int *)(bp))
+#define NEXT_FREE(bp)  TO_PTR(NEXT_LINK(bp))
+#define PREV_FREE(bp)  TO_PTR(PREV_LINK(bp))
+
+/* Given large free block ptr bp, read and write the epoch it was freed
+   in and, in address order, its links in the large bin's search tree:
+   heap offsets of its children and parent, and its random priority */
+#define FREE_EPOCH(bp) (*(unsigned long *)((char *)(bp) + DSIZE))
+#define TREE_LEFT(bp)  (*(unsigned int *)((char *)(bp) + 2*DSIZE))
+#define TREE_RIGHT(bp) (*(unsigned int *)((char *)(bp) + 2*DSIZE + WSIZE))
+#define TREE_UP(bp)    (*(unsigned int *)((char *)(bp) + 3*DSIZE))
+#define TREE_PRIO(bp)  (*(unsigned int *)((char *)(bp) + 3*DSIZE + WSIZE))
+#define FREE_TAGS      (4*DSIZE) /* bytes of links and stamps at the start
+                                    of a free block, which are not zero */
+
+/* Given block ptr bp, compute address of next and previous blocks */
+#define NEXT_BLKP(bp)  ((void *)(bp) + GET_SIZE(HDRP(bp)))                                  
+#define PREV_BLKP(bp)  ((void *)(bp) - GET_SIZE(HDRP(bp) - WSIZE))
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+
+/* Given region chunk c, read and write the offset of the next one */
+#define CHUNK_NEXT(c)  (*(unsigned int *)(c))
+
+/* Given a pool object p, compute its slab, and read and write the free
+   list link of the object while it is free */
+#define SLABP(p)      ((slab_t *)((size_t)(p) & ~(size_t)(SLAB_SIZE - 1)))
+#define OBJ_NEXT(p)   (*(unsigned int *)(p))
+
+/* Given block ptr bp of a block marked MMAPPED, whose header holds how
+   far into its mapping the block pointer is, compute the mapping */
+#define MAPP(bp)  ((char *)(bp) - GET_SIZE(HDRP(bp)))
+/* $end mallocmacros */
+
+#define MM_MAGIC 0x6d6d6831 /* marks an initialized control block */
+
+#if SIZE_CLASS_ALIGN != ALIGNMENT || SIZE_CLASS_MIN != OVERHEAD
+#error "mm_sizeclass.h was generated for another block layout; rerun mmbins"
+#endif
+
+/* 
+ * The state of the allocator. It is kept in a control block at the
+ * start of the heap rather than in globals, so that a copy of the heap
+ * (see mem_snapshot) is a complete copy of the allocator, and a heap
+ * reopened from a file (see mem_init_file) can be taken over with
+ * mm_attach. Like the free list links, its block pointers are heap
+ * offsets, so the heap does not have to come back at the same address.
+ *
+ * Purging: the large bin is kept in order of free time, newest first,
+ * and each block in it is stamped with the epoch it was freed in. The
+ * blocks at the tail that were freed before the previous epoch have
+ * been idle for a whole epoch, so their interior pages are released.
+ * Purged blocks collect at the tail, from purge_cursor onwards.
+ *
+ * Address order (MM_OPT_ADDR_ORDER): the large bin is kept in address
+ * order instead, so that find_fit scans it from low addresses up. A
+ * block that coalesces with a large free neighbour takes over the
+ * neighbour's place in the list. Any other block finds its place in
+ * a treap of the bin, whose links are in the blocks themselves, in
+ * logarithmic time. Purging then walks the bin with purge_cursor as
+ * the next block to look at, wrapping around at the end.
+ */
+typedef struct {
+    unsigned int magic; //MM_MAGIC once mm_init is done
+    int shared; //heap is shared with other processes; take the lock
+    pthread_mutex_t lock; //process-shared lock, used if shared
+    unsigned int heap_listp; //first block
+    unsigned int bins[NUM_SIZE_CLASSES]; //first free block of each size class
+    unsigned int large_tail; //oldest block of the large bin
+    unsigned int purge_cursor; //newest purged block of the large bin, if any
+    unsigned int root; //block set by mm_set_root
+    unsigned long purge_epoch; //current epoch
+    unsigned long purge_ops; //requests so far in this epoch
+    unsigned long calloc_bytes; //bytes requested from mm_calloc
+    unsigned long calloc_zero; //of those, bytes known zero and not cleared
+    unsigned int handles; //block holding the handle table
+    unsigned int nhandles; //entries in the handle table
+    unsigned int hfree; //first free entry of the handle table
+    int addr_order; //large bin in address order, with a search tree
+    unsigned int large_root; //root of the large bin's tree, if addr_order
+    unsigned long fit_searches; //large bin searches by find_fit
+    unsigned long fit_blocks; //blocks they looked at
+    unsigned long fit_bytes; //address distance between those blocks
+    unsigned long bad_frees; //frees turned down by mm_free_sized or mm_hfree
+} mm_ctl_t;
+
+/* Global variables */
+static mm_ctl_t *ctl; //control block at the start of the heap
+static size_t mmap_threshold = MMAP_THRESHOLD; //requests this big get mem_map
+static size_t purge_decay = PURGE_DECAY; //requests per epoch, 0 = none
+static size_t split_size = 0; //unhinted blocks this big go at the end of
+                              //the free block they are cut from, 0 = none
+static int addr_order = 0; //mm_init keeps the large bin in address order
+
+/* function prototypes for internal helper routines */
+static void lock(void);
+static void unlock(void);
+/*
+ * A region bump-allocates from chunks, which are ordinary allocated
+ * heap blocks, newest first, each starting with the offset of the
+ * next. The region itself lives at the start of its first chunk.
+ */
+struct mm_region {
+    unsigned int chunk; //chunk that allocations come from
+    unsigned int top; //first free byte in it
+    unsigned int end; //end of its payload
+};
+
+/*
+ * A pool hands out objects of one size from slabs: heap blocks of
+ * SLAB_SIZE bytes aligned to SLAB_SIZE, so that an object finds its
+ * slab by masking its address. Objects have no header. A slab keeps
+ * its free objects on a list and hands out the ones it never used
+ * from its top, so a new slab is not touched up front. The slabs
+ * with free objects are on a list of the pool's; full slabs are on
+ * none. Larger objects are ordinary blocks.
+ */
+struct mm_pool {
+    unsigned int objsize; //bytes per object, aligned
+    unsigned int slabs; //slabs with free objects
+};
+
+typedef struct {
+    unsigned int next, prev; //on the pool's list of slabs with room
+    unsigned int free; //first free object
+    unsigned int top; //first object never handed out
+    unsigned int used; //objects handed out and not freed
+} slab_t;
+
+/*
+ * A handle is the number of an entry in the handle table, a heap
+ * block that the control block points to. The entry holds the offset
+ * of the handle's block, which mm_compact may move while the handle
+ * is unlocked, and its lock count. Free entries are linked through
+ * their block field and have a lock count of HFREE. Entry 0 is never
+ * used, so that handle 0 can mean none.
+ */
+typedef struct {
+    unsigned int block; //block of the handle, or next free entry
+    unsigned int locks; //mm_hlock calls not yet undone by mm_hunlock
+} hentry_t;
+
+#define HFREE  0xffffffff /* lock count of a free entry */
+#define HTABLE_MIN 64     /* entries in the first handle table */
+
+static void *malloc_block(size_t size);
+static void *malloc_hint_block(size_t size, int hint);
+static void *memalign_block(size_t align, size_t size);
+static void *calloc_block(size_t size);
+static size_t malloc_batch(size_t size, size_t n, void **ptrs);
+static void free_batch(void **ptrs, size_t n);
+static int compare_ptrs(const void *a, const void *b);
+static mm_region_t *region_create(void);
+static void *region_alloc(mm_region_t *r, size_t size);
+static void region_destroy(mm_region_t *r);
+static void *heap_block(size_t size);
+static void *heap_aligned_block(size_t align, size_t size);
+static mm_pool_t *pool_create(size_t objsize);
+static void *pool_alloc(mm_pool_t *pool);
+static void pool_free(mm_pool_t *pool, void *p);
+static void pool_destroy(mm_pool_t *pool);
+static void slab_link(mm_pool_t *pool, slab_t *s);
+static void slab_unlink(mm_pool_t *pool, slab_t *s);
+static mm_handle_t halloc(size_t size);
+static hentry_t *hentry(mm_handle_t h);
+static void hfree(mm_handle_t h);
+static size_t compact(void);
+static void free_block(void *bp);
+static void *realloc_block(void *ptr, size_t size);
+static void *extend_heap(size_t words);
+static size_t adjust(size_t size);
+static int free_class(size_t size);
+static void *map_block(void *p, size_t off);
+static size_t block_size(void *bp);
+static void tick(void);
+static size_t purge_old(int max);
+static void place(void *bp, size_t asize);
+static void *place_back(void *bp, size_t asize);
+static void *place_aligned(void *bp, size_t asize, size_t align);
+static void *find_fit(size_t asize);
+static void *find_aligned_fit(size_t asize, size_t align);
+static size_t align_lead(void *bp, size_t align);
+static void *coalesce(void *bp);
+static void clear_tags(void *bp);
+static void add(void *bp);
+static void delete(void *bp);
+static void relink(void *old, void *bp);
+static void tree_insert(void *bp);
+static void tree_remove(void *bp);
+static void tree_rotate_up(void *bp);
+static size_t purge_block(void *bp);
+static void printblock(void *bp); 
+static void checkblock(void *bp);
+static void checkbins(void);
+static void checkhandles(unsigned int hblocks);
+
+/* 
+ * mm_init - Initialize the memory manager 
+ */
+/* $begin mminit */
+int mm_init(void) 
+{
+    int i;
+    char *heap_listp;
+
+    /* create the control block and the initial empty heap */
+    if ((ctl = mem_sbrk(ALIGN(sizeof(mm_ctl_t)))) == (void *)-1)
+	return -1;
+    if ((heap_listp = mem_sbrk(2*ALIGNMENT)) == (void *)-1)
+	return -1;
+    heap_listp += ALIGNMENT;        /* payloads are aligned, headers not */
+    memset(heap_listp - ALIGNMENT, 0, ALIGNMENT - WSIZE); /* alignment padding */
+    PUT(HDRP(heap_listp), PACK(ALIGNMENT, 1)); /* prologue header */ 
+    PUT(FTRP(heap_listp), PACK(ALIGNMENT, 1)); /* prologue footer */ 
+    PUT(HDRP(NEXT_BLKP(heap_listp)), PACK(0, 1)); /* epilogue header */
+    ctl->heap_listp = TO_OFF(heap_listp);
+    for (i = 0; i < NUM_SIZE_CLASSES; i++)
+	ctl->bins[i] = 0;
+    ctl->large_tail = ctl->purge_cursor = ctl->root = 0;
+    ctl->purge_epoch = ctl->purge_ops = 0;
+    ctl->calloc_bytes = ctl->calloc_zero = 0;
+    ctl->handles = ctl->nhandles = ctl->hfree = 0;
+    ctl->addr_order = addr_order;
+    ctl->large_root = 0;
+    ctl->fit_searches = ctl->fit_blocks = ctl->fit_bytes = 0;
+    ctl->bad_frees = 0;
+    ctl->shared = mem_is_shared();
+    if (ctl->shared) {
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&ctl->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+    }
+    ctl->magic = MM_MAGIC;
+
+    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+    if (extend_heap(MAX(CHUNKSIZE, OVERHEAD)/WSIZE) == NULL)
+	return -1;
+    return 0;
+}
+/* $end mminit */
+
+/*
+ * mm_attach - Take over a heap that mm_init set up earlier, such as
+ *     one that memlib has reopened from a file, without touching its
+ *     blocks. Returns 0 on success and -1 if the heap does not start
+ *     with a control block. Processes that share a heap through fork
+ *     need not attach; they inherit the package with the mapping.
+ */
+int mm_attach(void)
+{
+    mm_ctl_t *c = mem_heap_lo();
+
+    if (mem_heapsize() < sizeof(mm_ctl_t) || c->magic != MM_MAGIC)
+	return -1;
+    ctl = c;
+    return 0;
+}
+
+/*
+ * mm_set_root - Remember the block bp (or NULL) in the heap, so that a
+ *     program that attaches to the heap later can find its data again
+ */
+void mm_set_root(void *bp)
+{
+    lock();
+    ctl->root = TO_OFF(bp);
+    unlock();
+}
+
+/*
+ * mm_get_root - Return the block last given to mm_set_root, or NULL
+ */
+void *mm_get_root(void)
+{
+    return TO_PTR(ctl->root);
+}
+
+/*
+ * mm_malloc, mm_free, mm_realloc, mm_memalign and mm_calloc - The entry points.
+ *     If the heap is shared with other processes, they hold the lock in
+ *     the control block while they work on it.
+ */
+void *mm_malloc(size_t size)
+{
+    void *bp;
+
+    lock();
+    bp = malloc_block(size);
+    unlock();
+    return bp;
+}
+
+void *mm_malloc_hint(size_t size, int hint)
+{
+    void *bp;
+
+    lock();
+    bp = malloc_hint_block(size, hint);
+    unlock();
+    return bp;
+}
+
+void mm_free(void *bp)
+{
+    lock();
+    free_block(bp);
+    unlock();
+}
+
+/*
+ * mm_free_sized - Free bp, which the caller knows to hold size bytes,
+ *     as C++ sized delete does. Coalescing reads the block's own tags
+ *     anyway, so the size only serves as a check: a block too small
+ *     for it is a bad or double free, which is ignored and counted in
+ *     MM_STAT_BAD_FREES.
+ */
+void mm_free_sized(void *bp, size_t size)
+{
+    lock();
+    if (bp != NULL && (GET_ALLOC(HDRP(bp)) == 0 || size > block_size(bp) - DSIZE))
+	ctl->bad_frees++;
+    else
+	free_block(bp);
+    unlock();
+}
+
+void *mm_realloc(void *ptr, size_t size)
+{
+    void *newp;
+
+    lock();
+    newp = realloc_block(ptr, size);
+    unlock();
+    return newp;
+}
+
+void *mm_memalign(size_t align, size_t size)
+{
+    void *bp;
+
+    lock();
+    bp = memalign_block(align, size);
+    unlock();
+    return bp;
+}
+
+void *mm_calloc(size_t nmemb, size_t size)
+{
+    void *bp;
+
+    if (size != 0 && nmemb > (size_t)-1 / size)
+	return NULL;
+    lock();
+    bp = calloc_block(nmemb * size);
+    unlock();
+    return bp;
+}
+
+/*
+ * mm_malloc_batch and mm_free_batch - Allocate n blocks of size bytes
+ *     into ptrs, returning how many were allocated, which is fewer than
+ *     n only if memory runs out; and free the n blocks in ptrs, which
+ *     may be sorted into address order on the way.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+    size_t done;
+
+    lock();
+    done = malloc_batch(size, n, ptrs);
+    unlock();
+    return done;
+}
+
+void mm_free_batch(void **ptrs, size_t n)
+{
+    lock();
+    free_batch(ptrs, n);
+    unlock();
+}
+
+/* 
+ * malloc_block - Allocate a block with at least size bytes of payload 
+ */
+static void *malloc_block(size_t size)
+{
+    return malloc_hint_block(size, MM_HINT_NONE);
+}
+
+/*
+ * malloc_hint_block - Allocate a block with at least size bytes of
+ *     payload, expected to live as long as hint says. Short-lived
+ *     blocks are carved from the end of the free block they go in and
+ *     all others from the start, so that the two kinds pile up at
+ *     opposite ends of free areas, and the short-lived ones coalesce
+ *     back into large free blocks rather than around long-lived ones.
+ *     Hinted requests extend the heap by HINT_CHUNKSIZE at least, to
+ *     leave them a free block with two ends to fill. Without a hint,
+ *     blocks of at least split_size bytes, if it is set, go at the
+ *     end like short-lived ones, so that small blocks do not end up
+ *     between large ones.
+ */
+/* $begin mmmalloc */
+static void *malloc_hint_block(size_t size, int hint) 
+{
+    size_t asize;      /* adjusted block size */
+    size_t extendsize; /* amount to extend heap if no fit */
+    char *bp;      
+
+    /* Ignore spurious requests */
+    if (size <= 0)
+	return NULL;
+
+    tick();
+
+    /* Huge blocks get a mapping of their own, outside the heap,
+       if memlib can give them one */
+    if (size >= mmap_threshold && (bp = map_block(mem_map(size + ALIGNMENT), ALIGNMENT)) != NULL)
+	return bp;
+
+    asize = adjust(size);
+    
+    /* Search the free list for a fit, or else get more memory */
+    if ((bp = find_fit(asize)) == NULL) {
+	extendsize = MAX(asize, (hint == MM_HINT_NONE && split_size == 0) ?
+			 CHUNKSIZE : HINT_CHUNKSIZE);
+	if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+	    return NULL;
+    }
+
+    if (hint == MM_HINT_SHORT ||
+	(hint == MM_HINT_NONE && split_size > 0 && asize >= split_size))
+	return place_back(bp, asize);
+    place(bp, asize);
+    return bp;
+} 
+/* $end mmmalloc */
+
+/*
+ * calloc_block - Allocate a block with at least size bytes of zeroed
+ *     payload. Mappings come zeroed, and a free block tagged ZEROED
+ *     only needs its free list links cleared. A block tagged PURGED
+ *     needs only the parts outside its released pages cleared, unless
+ *     those pages read back as a restored snapshot. Only recycled
+ *     blocks are cleared in full.
+ */
+static void *calloc_block(size_t size)
+{
+    size_t asize, head, tail;
+    size_t pg = mem_pagesize();
+    char *bp, *lo, *hi;
+
+    if (size <= 0)
+	return NULL;
+
+    tick();
+    ctl->calloc_bytes += size;
+
+    if (size >= mmap_threshold &&
+	(bp = map_block(mem_map(size + ALIGNMENT), ALIGNMENT)) != NULL) {
+	ctl->calloc_zero += size;
+	return bp;
+    }
+
+    asize = adjust(size);
+    if ((bp = find_fit(asize)) == NULL &&
+	(bp = extend_heap(MAX(asize, CHUNKSIZE)/WSIZE)) == NULL)
+	return NULL;
+    /* The payload is zero from head up to tail */
+    head = tail = size;
+    if (GET_ZEROED(HDRP(bp)))
+	head = MIN(size, FREE_TAGS);
+    else if (GET_PURGED(HDRP(bp))) {
+	lo = (char *)(((unsigned long)bp + FREE_TAGS + pg - 1) & ~(unsigned long)(pg - 1));
+	hi = (char *)((unsigned long)FTRP(bp) & ~(unsigned long)(pg - 1));
+	if (lo < (char *)mem_purge_zero_lo())
+	    lo = mem_purge_zero_lo();
+	if (lo < hi && lo < bp + size) {
+	    head = lo - bp;
+	    tail = MIN(size, hi - bp);
+	}
+    }
+    place(bp, asize);
+    memset(bp, 0, head);
+    memset(bp + tail, 0, size - tail);
+    ctl->calloc_zero += tail - head;
+    return bp;
+}
+
+/*
+ * mm_region_create, mm_region_alloc and mm_region_destroy - Make a
+ *     region, allocate from it, and free it with everything allocated
+ *     from it. Its pieces are freed only with the region, never with
+ *     mm_free.
+ */
+mm_region_t *mm_region_create(void)
+{
+    mm_region_t *r;
+
+    lock();
+    r = region_create();
+    unlock();
+    return r;
+}
+
+void *mm_region_alloc(mm_region_t *r, size_t size)
+{
+    void *p;
+
+    lock();
+    p = region_alloc(r, size);
+    unlock();
+    return p;
+}
+
+void mm_region_destroy(mm_region_t *r)
+{
+    if (r == NULL)
+	return;
+    lock();
+    region_destroy(r);
+    unlock();
+}
+
+/*
+ * mm_pool_create, mm_pool_alloc, mm_pool_free and mm_pool_destroy -
+ *     Make a pool of objects of one size, allocate an object from it
+ *     and free one back to it, and free the pool once it is empty
+ */
+mm_pool_t *mm_pool_create(size_t objsize)
+{
+    mm_pool_t *pool;
+
+    lock();
+    pool = pool_create(objsize);
+    unlock();
+    return pool;
+}
+
+void *mm_pool_alloc(mm_pool_t *pool)
+{
+    void *p;
+
+    lock();
+    p = pool_alloc(pool);
+    unlock();
+    return p;
+}
+
+void mm_pool_free(mm_pool_t *pool, void *p)
+{
+    if (p == NULL)
+	return;
+    lock();
+    pool_free(pool, p);
+    unlock();
+}
+
+void mm_pool_destroy(mm_pool_t *pool)
+{
+    if (pool == NULL)
+	return;
+    lock();
+    pool_destroy(pool);
+    unlock();
+}
+
+/*
+ * mm_halloc, mm_hlock, mm_hunlock and mm_hfree - Allocate a block that
+ *     is known by a handle rather than by its address, get its address
+ *     and pin it there, unpin it, and free it. mm_compact may move the
+ *     block whenever it is not locked, so the address from mm_hlock is
+ *     good only until the matching mm_hunlock. mm_halloc returns 0 if
+ *     it runs out of memory.
+ */
+mm_handle_t mm_halloc(size_t size)
+{
+    mm_handle_t h;
+
+    lock();
+    h = halloc(size);
+    unlock();
+    return h;
+}
+
+void *mm_hlock(mm_handle_t h)
+{
+    hentry_t *e;
+    char *p = NULL;
+
+    lock();
+    if ((e = hentry(h)) != NULL) {
+	e->locks++;
+	p = TO_PTR(e->block);
+    }
+    unlock();
+    return p;
+}
+
+void mm_hunlock(mm_handle_t h)
+{
+    hentry_t *e;
+
+    lock();
+    if ((e = hentry(h)) != NULL && e->locks > 0)
+	e->locks--;
+    unlock();
+}
+
+void mm_hfree(mm_handle_t h)
+{
+    lock();
+    hfree(h);
+    unlock();
+}
+
+/*
+ * mm_compact - Slide every unlocked handle block down over the free
+ *     blocks below it, so that the free space gathers between locked
+ *     or ordinary blocks and at the top of the heap, and shrink the
+ *     heap by the free space at the top. Returns the number of bytes
+ *     the heap shrank by.
+ */
+size_t mm_compact(void)
+{
+    size_t released;
+
+    lock();
+    released = compact();
+    unlock();
+    return released;
+}
+
+/*
+ * malloc_batch - Allocate n blocks of size bytes side by side, carved
+ *     out of one free block that is found or made for all of them, so
+ *     that the size is adjusted and the free lists updated only once.
+ *     Huge blocks, and batches that no free block or heap growth can
+ *     hold at once, are allocated one by one.
+ */
+static size_t malloc_batch(size_t size, size_t n, void **ptrs)
+{
+    size_t asize, csize, rest, i;
+    unsigned int zero;
+    char *bp;
+
+    if (size <= 0 || n == 0)
+	return 0;
+
+    asize = adjust(size);
+    if (size >= mmap_threshold || n > MAX_OFFSET / asize ||
+	((bp = find_fit(n * asize)) == NULL &&
+	 (bp = extend_heap(MAX(n * asize, CHUNKSIZE)/WSIZE)) == NULL)) {
+	for (i = 0; i < n; i++)
+	    if ((ptrs[i] = malloc_block(size)) == NULL)
+		break;
+	return i;
+    }
+
+    /* Carve the blocks from the front, then split off what is left */
+    csize = GET_SIZE(HDRP(bp));
+    zero = GET_ZEROED(HDRP(bp));
+    delete(bp);
+    for (i = 0; i < n; i++) {
+	PUT(HDRP(bp), PACK(asize, 1));
+	PUT(FTRP(bp), PACK(asize, 1));
+	ptrs[i] = bp;
+	bp = NEXT_BLKP(bp);
+    }
+    rest = csize - n * asize;
+    if (rest >= OVERHEAD) {
+	PUT(HDRP(bp), PACK(rest, zero));
+	PUT(FTRP(bp), PACK(rest, zero));
+	coalesce(bp);
+    }
+    else if (rest > 0) {
+	bp = ptrs[n - 1];
+	PUT(HDRP(bp), PACK(asize + rest, 1));
+	PUT(FTRP(bp), PACK(asize + rest, 1));
+    }
+    for (i = 0; i < n; i++)
+	tick();
+    return n;
+}
+
+/*
+ * free_batch - Free the n blocks in ptrs. In address order, blocks
+ *     that lie side by side are joined before they are freed, so that
+ *     each run of them is coalesced and put on a free list only once.
+ */
+static void free_batch(void **ptrs, size_t n)
+{
+    size_t i, j, size;
+    char *bp;
+
+    /* Blocks from one mm_malloc_batch are usually in order already */
+    for (i = 1; i < n && (char *)ptrs[i - 1] <= (char *)ptrs[i]; i++)
+	;
+    if (i < n)
+	qsort(ptrs, n, sizeof(void *), compare_ptrs);
+
+    for (i = 0; i < n; i = j) {
+	bp = ptrs[i];
+	j = i + 1;
+	if (bp == NULL || GET_MMAPPED(HDRP(bp))) {
+	    free_block(bp);
+	    continue;
+	}
+	size = GET_SIZE(HDRP(bp));
+	while (j < n && (char *)ptrs[j] == bp + size) {
+	    size += GET_SIZE(HDRP(ptrs[j]));
+	    tick();
+	    j++;
+	}
+	PUT(HDRP(bp), PACK(size, 1));
+	PUT(FTRP(bp), PACK(size, 1));
+	free_block(bp);
+    }
+}
+
+/*
+ * region_create - Make an empty region in a chunk of its own
+ */
+static mm_region_t *region_create(void)
+{
+    char *c;
+    mm_region_t *r;
+
+    if ((c = heap_block(REGION_CHUNK)) == NULL)
+	return NULL;
+    CHUNK_NEXT(c) = 0;
+    r = (mm_region_t *)(c + REGION_HDR);
+    r->chunk = TO_OFF(c);
+    r->top = TO_OFF(c + REGION_HDR + ALIGN(sizeof(mm_region_t)));
+    r->end = TO_OFF(c + GET_SIZE(HDRP(c)) - DSIZE);
+    return r;
+}
+
+/*
+ * region_alloc - Bump-allocate size bytes from region r, starting a
+ *     new chunk when the one in use is full. A piece too big to share
+ *     a chunk gets one of its own, linked in behind the one in use.
+ */
+static void *region_alloc(mm_region_t *r, size_t size)
+{
+    size_t asize;
+    char *c, *cur;
+
+    if (size <= 0 || size >= MAX_OFFSET)
+	return NULL;
+
+    asize = ALIGN(size);
+    if (asize <= r->end - r->top) {
+	r->top += asize;
+	return TO_PTR(r->top - asize);
+    }
+
+    if (asize > REGION_CHUNK / 4) {
+	if ((c = heap_block(REGION_HDR + asize)) == NULL)
+	    return NULL;
+	cur = TO_PTR(r->chunk);
+	CHUNK_NEXT(c) = CHUNK_NEXT(cur);
+	CHUNK_NEXT(cur) = TO_OFF(c);
+	return c + REGION_HDR;
+    }
+
+    if ((c = heap_block(REGION_CHUNK)) == NULL)
+	return NULL;
+    CHUNK_NEXT(c) = r->chunk;
+    r->chunk = TO_OFF(c);
+    r->top = TO_OFF(c + REGION_HDR + asize);
+    r->end = TO_OFF(c + GET_SIZE(HDRP(c)) - DSIZE);
+    return c + REGION_HDR;
+}
+
+/*
+ * region_destroy - Free every chunk of region r, the region included
+ */
+static void region_destroy(mm_region_t *r)
+{
+    char *c, *next;
+
+    for (c = TO_PTR(r->chunk); c != NULL; c = next) {
+	next = TO_PTR(CHUNK_NEXT(c));
+	free_block(c);
+    }
+}
+
+/*
+ * heap_block - Allocate a block of at least size bytes of payload for
+ *     the package's own use. It always comes from the heap, never from
+ *     a mapping of its own, so that it can be linked by heap offset.
+ */
+static void *heap_block(size_t size)
+{
+    size_t asize = adjust(size);
+    char *bp;
+
+    tick();
+    if ((bp = find_fit(asize)) == NULL &&
+	(bp = extend_heap(MAX(asize, CHUNKSIZE)/WSIZE)) == NULL)
+	return NULL;
+    place(bp, asize);
+    return bp;
+}
+
+/*
+ * compare_ptrs - qsort comparison of two pointers by address
+ */
+static int compare_ptrs(const void *a, const void *b)
+{
+    char *p = *(char **)a, *q = *(char **)b;
+
+    return (p > q) - (p < q);
+}
+
+/*
+ * pool_create - Make a pool of objects of objsize bytes
+ */
+static mm_pool_t *pool_create(size_t objsize)
+{
+    mm_pool_t *pool;
+
+    if (objsize <= 0 || objsize >= MAX_OFFSET ||
+	(pool = heap_block(sizeof(mm_pool_t))) == NULL)
+	return NULL;
+    pool->objsize = ALIGN(MAX(objsize, WSIZE));
+    pool->slabs = 0;
+    return pool;
+}
+
+/*
+ * pool_alloc - Pop an object off the first slab with room, making a
+ *     new slab if there is none
+ */
+static void *pool_alloc(mm_pool_t *pool)
+{
+    slab_t *s;
+    char *p;
+
+    if (pool->objsize > SLAB_MAX_OBJ)
+	return malloc_block(pool->objsize);
+
+    if ((s = (slab_t *)TO_PTR(pool->slabs)) == NULL) {
+	tick();
+	if ((s = heap_aligned_block(SLAB_SIZE, SLAB_SIZE)) == NULL)
+	    return NULL;
+	s->free = s->used = 0;
+	s->top = TO_OFF((char *)s + ALIGN(sizeof(slab_t)));
+	slab_link(pool, s);
+    }
+
+    if (s->free) {
+	p = TO_PTR(s->free);
+	s->free = OBJ_NEXT(p);
+    }
+    else {
+	p = TO_PTR(s->top);
+	s->top += pool->objsize;
+    }
+    s->used++;
+    if (!s->free && s->top + pool->objsize > TO_OFF(s) + SLAB_SIZE)
+	slab_unlink(pool, s);
+    return p;
+}
+
+/*
+ * pool_free - Push object p back on its slab, and give the slab back to
+ *     the heap once it is empty, unless it is the pool's last one
+ */
+static void pool_free(mm_pool_t *pool, void *p)
+{
+    slab_t *s = SLABP(p);
+
+    if (pool->objsize > SLAB_MAX_OBJ) {
+	free_block(p);
+	return;
+    }
+
+    if (!s->free && s->top + pool->objsize > TO_OFF(s) + SLAB_SIZE)
+	slab_link(pool, s); /* it was full */
+    OBJ_NEXT(p) = s->free;
+    s->free = TO_OFF(p);
+    if (--s->used == 0 && (s->next || s->prev)) {
+	slab_unlink(pool, s);
+	free_block(s);
+    }
+}
+
+/*
+ * pool_destroy - Free a pool whose objects have all been freed
+ */
+static void pool_destroy(mm_pool_t *pool)
+{
+    slab_t *s, *next;
+
+    for (s = (slab_t *)TO_PTR(pool->slabs); s != NULL; s = next) {
+	next = (slab_t *)TO_PTR(s->next);
+	free_block(s);
+    }
+    free_block(pool);
+}
+
+/*
+ * slab_link and slab_unlink - Add slab s to the front of, and remove it
+ *     from, the list of the pool's slabs with free objects
+ */
+static void slab_link(mm_pool_t *pool, slab_t *s)
+{
+    s->prev = 0;
+    s->next = pool->slabs;
+    if (pool->slabs)
+	((slab_t *)TO_PTR(pool->slabs))->prev = TO_OFF(s);
+    pool->slabs = TO_OFF(s);
+}
+
+static void slab_unlink(mm_pool_t *pool, slab_t *s)
+{
+    if (s->prev)
+	((slab_t *)TO_PTR(s->prev))->next = s->next;
+    else
+	pool->slabs = s->next;
+    if (s->next)
+	((slab_t *)TO_PTR(s->next))->prev = s->prev;
+}
+
+/*
+ * halloc - Allocate a handle and a heap block of size bytes for it.
+ *     The table doubles when it is full; it is an ordinary block, which
+ *     compact never moves.
+ */
+static mm_handle_t halloc(size_t size)
+{
+    hentry_t *tab = (hentry_t *)TO_PTR(ctl->handles), *newtab;
+    unsigned int n = ctl->nhandles, i;
+    mm_handle_t h;
+    char *bp;
+
+    if (size <= 0 || size >= MAX_OFFSET)
+	return 0;
+
+    /* Take a free entry, growing the table if there is none */
+    if (ctl->hfree == 0) {
+	n = (n == 0) ? HTABLE_MIN : 2 * n;
+	if ((newtab = heap_block(n * sizeof(hentry_t))) == NULL)
+	    return 0;
+	if (tab != NULL) {
+	    memcpy(newtab, tab, ctl->nhandles * sizeof(hentry_t));
+	    free_block(tab);
+	}
+	for (i = (ctl->nhandles == 0) ? 1 : ctl->nhandles; i < n; i++) {
+	    newtab[i].block = (i + 1 < n) ? i + 1 : 0;
+	    newtab[i].locks = HFREE;
+	}
+	ctl->hfree = (ctl->nhandles == 0) ? 1 : ctl->nhandles;
+	ctl->handles = TO_OFF(newtab);
+	ctl->nhandles = n;
+	tab = newtab;
+    }
+
+    if ((bp = heap_block(size)) == NULL)
+	return 0;
+    h = ctl->hfree;
+    ctl->hfree = tab[h].block;
+    tab[h].block = TO_OFF(bp);
+    tab[h].locks = 0;
+    PUT(HDRP(bp), GET(HDRP(bp)) | HANDLE);
+    PUT(FTRP(bp), GET(FTRP(bp)) | HANDLE);
+    return h;
+}
+
+/*
+ * hentry - Return the table entry of handle h, or NULL if h is not
+ *     an allocated handle
+ */
+static hentry_t *hentry(mm_handle_t h)
+{
+    hentry_t *e;
 
-#define MAX(x, y) ((x) > (y)? (x) : (y))  
+    if (h == 0 || h >= ctl->nhandles)
+	return NULL;
+    e = (hentry_t *)TO_PTR(ctl->handles) + h;
+    return (e->locks == HFREE) ? NULL : e;
+}
 
-/* Pack a size and allocated bit into a word */
-#define PACK(size, alloc)  ((size) | (alloc))
+/*
+ * hfree - Free the block of handle h, locked or not, and the handle.
+ *     Anything but a handle or 0 is ignored and counted as a bad free.
+ */
+static void hfree(mm_handle_t h)
+{
+    hentry_t *e;
 
-/* Read and write a word at address p */
-#define GET(p)       (*(size_t *)(p))
-#define PUT(p, val)  (*(size_t *)(p) = (val))  
+    if ((e = hentry(h)) == NULL) {
+	if (h != 0)
+	    ctl->bad_frees++;
+	return;
+    }
+    free_block(TO_PTR(e->block));
+    e->block = ctl->hfree;
+    e->locks = HFREE;
+    ctl->hfree = h;
+}
 
-/* Read the size and allocated fields from address p */
-#define GET_SIZE(p)  (GET(p) & ~0x7)
-#define GET_ALLOC(p) (GET(p) & 0x1)
+/*
+ * compact - Walk the heap, sliding each unlocked handle block down to
+ *     the start of the free run below it, if any. The run moves up
+ *     past the block, and becomes a free block when it reaches a
+ *     block that stays put. The bins are rebuilt along the way, so
+ *     free blocks lose their zero and purge tags and their free time.
+ *     A run that reaches the epilogue is cut off the heap.
+ *
+ *     Blocks do not record their handles. Instead, for the walk, each
+ *     unlocked block lends its first word to its handle's number, and
+ *     the table entry keeps the word until the walk puts it back.
+ *     Locked blocks, whose owners may be using them, are left alone
+ *     and lose their HANDLE bit until the walk is done.
+ */
+static size_t compact(void)
+{
+    hentry_t *tab = (hentry_t *)TO_PTR(ctl->handles);
+    char *bp, *next, *hole = NULL;
+    size_t size, released = 0;
+    unsigned int h, word;
+    int i;
 
-/* Given block ptr bp, compute address of its header and footer */
-#define HDRP(bp)  ((void *)(bp) - WSIZE)                                                    
-#define FTRP(bp)  ((void *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)       
+    for (h = 1; h < ctl->nhandles; h++) {
+	if (tab[h].locks == HFREE)
+	    continue;
+	bp = TO_PTR(tab[h].block);
+	if (tab[h].locks > 0) {
+	    PUT(HDRP(bp), GET(HDRP(bp)) & ~HANDLE);
+	    PUT(FTRP(bp), GET(FTRP(bp)) & ~HANDLE);
+	}
+	else {
+	    tab[h].block = *(unsigned int *)bp;
+	    *(unsigned int *)bp = h;
+	}
+    }
 
-/* Given block ptr bp, compute address of next and previous blocks */
-#define NEXT_FREE(bp)  (*(void **)(bp + WSIZE))                                            
-#define PREV_FREE(bp)  (*(void **)(bp)) 
-#define NEXT_BLKP(bp)  ((void *)(bp) + GET_SIZE(HDRP(bp)))                                  
-#define PREV_BLKP(bp)  ((void *)(bp) - GET_SIZE(HDRP(bp) - WSIZE))
-#define ALIGN(size) (((size) + 7) & ~0x7)
-/* $end mallocmacros */
+    for (i = 0; i < NUM_SIZE_CLASSES; i++)
+	ctl->bins[i] = 0;
+    ctl->large_tail = ctl->purge_cursor = ctl->large_root = 0;
 
-/* Global variables */
-static char *heap_listp; //pointer to first block
-static char *head; //pointer to first free block
+    for (bp = TO_PTR(ctl->heap_listp); (size = GET_SIZE(HDRP(bp))) > 0; bp = next) {
+	next = NEXT_BLKP(bp);
+	if (!GET_ALLOC(HDRP(bp))) {
+	    if (hole == NULL)
+		hole = bp;
+	    continue;
+	}
+	if (GET_HANDLE(HDRP(bp))) {
+	    h = *(unsigned int *)bp;
+	    word = tab[h].block;
+	    if (hole != NULL) {
+		memmove(HDRP(hole), HDRP(bp), size);
+		bp = hole;
+		hole += size;
+	    }
+	    *(unsigned int *)bp = word;
+	    tab[h].block = TO_OFF(bp);
+	}
+	else if (hole != NULL) {
+	    PUT(HDRP(hole), PACK(bp - hole, 0));
+	    PUT(FTRP(hole), PACK(bp - hole, 0));
+	    add(hole);
+	    hole = NULL;
+	}
+    }
 
-/* function prototypes for internal helper routines */
-static void *extend_heap(size_t words);
-static void place(void *bp, size_t asize);
-static void *find_fit(size_t asize);
-static void *coalesce(void *bp);
-static void add(void *bp);
-static void delete(void *bp);
-static void printblock(void *bp); 
-static void checkblock(void *bp);
+    for (h = 1; h < ctl->nhandles; h++)
+	if (tab[h].locks != HFREE && tab[h].locks > 0) {
+	    next = TO_PTR(tab[h].block);
+	    PUT(HDRP(next), GET(HDRP(next)) | HANDLE);
+	    PUT(FTRP(next), GET(FTRP(next)) | HANDLE);
+	}
 
-/* 
- * mm_init - Initialize the memory manager 
+    /* bp is past the epilogue header; a free run ending there goes */
+    if (hole != NULL) {
+	released = bp - hole;
+	PUT(HDRP(hole), PACK(0, 1));
+	mem_trim(released);
+    }
+    return released;
+}
+
+/*
+ * memalign_block - Allocate a block with at least size bytes of payload
+ *     aligned to align, a power of two. The block is carved out of a
+ *     free block with room for the aligned payload; the part in front
+ *     of the payload and the part after it become free blocks of their
+ *     own, so the result is an ordinary block that free_block takes.
  */
-/* $begin mminit */
-int mm_init(void) 
+static void *memalign_block(size_t align, size_t size)
 {
-    /* create the initial empty heap */
-    if ((heap_listp = mem_sbrk(2*OVERHEAD)) == NULL)
-	return -1;
-    PUT(heap_listp, 0);                        /* alignment padding */
-    PUT(heap_listp+WSIZE, PACK(OVERHEAD, 1));  /* prologue header */ 
-    PUT(heap_listp + DSIZE, 0);                                 
-    PUT(heap_listp + 3*WSIZE, 0);    
-    PUT(heap_listp+OVERHEAD, PACK(OVERHEAD, 1));  /* prologue footer */ 
-    PUT(heap_listp+WSIZE+ 3*DSIZE, PACK(0, 1));   /* epilogue header */
-    head = heap_listp + DSIZE;  
+    char *p;
 
-    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
-	return -1;
-    return 0;
+    if (size <= 0 || align == 0 || (align & (align - 1)))
+	return NULL;
+    if (align <= ALIGNMENT)
+	return malloc_block(size);
+
+    tick();
+
+    /* Huge blocks get a mapping of their own, with the block pointer
+       as far into it as the alignment needs */
+    if (size >= mmap_threshold && (p = mem_map(size + ALIGNMENT + align)) != NULL)
+	return map_block(p, (((size_t)p + ALIGNMENT + align - 1) &
+			     ~(align - 1)) - (size_t)p);
+
+    return heap_aligned_block(align, size);
 }
-/* $end mminit */
 
-/* 
- * mm_malloc - Allocate a block with at least size bytes of payload 
+/*
+ * heap_aligned_block - Allocate a block with at least size bytes of
+ *     payload aligned to align, a power of two above ALIGNMENT, from
+ *     the heap, never from a mapping of its own
  */
-/* $begin mmmalloc */
-void *mm_malloc(size_t size) 
+static void *heap_aligned_block(size_t align, size_t size)
 {
-    size_t asize;      /* adjusted block size */
-    size_t extendsize; /* amount to extend heap if no fit */
-    char *bp;      
-
-    /* Ignore spurious requests */
-    if (size <= 0)
-	return NULL;
+    size_t asize = adjust(size);
+    char *bp;
 
-    asize = MAX(ALIGN(size) + DSIZE, OVERHEAD);                 
-    
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {
-		place(bp, asize);
-		return bp;
-    }
+    if ((bp = find_aligned_fit(asize, align)) != NULL)
+	return place_aligned(bp, asize, align);
 
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize,CHUNKSIZE);
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+    /* Any free block of this size has room for the payload and a
+       leading free block */
+    if ((bp = extend_heap(MAX(asize + align + OVERHEAD, CHUNKSIZE)/WSIZE)) == NULL)
 	return NULL;
-    place(bp, asize);
-    return bp;
-} 
-/* $end mmmalloc */
+    return place_aligned(bp, asize, align);
+}
 
 /* 
- * mm_free - Free a block 
+ * free_block - Free a block 
  */
 /* $begin mmfree */
-void mm_free(void *bp)
+static void free_block(void *bp)
 {
     if(bp == NULL)                                           
     return;
 
+    tick();
     size_t size = GET_SIZE(HDRP(bp));                           
 
+    if(GET_MMAPPED(HDRP(bp))){
+        mem_unmap(MAPP(bp));
+        return;
+    }
+
     PUT(HDRP(bp), PACK(size, 0));                               
     PUT(FTRP(bp), PACK(size, 0));                               
     coalesce(bp);    
@@ -161,55 +1273,151 @@ void mm_free(void *bp)
 /* $end mmfree */
 
 /*
- * mm_realloc - naive implementation of mm_realloc
+ * realloc_block - naive implementation of mm_realloc
  */
-void *mm_realloc(void *ptr, size_t size)
+static void *realloc_block(void *ptr, size_t size)
 {
     //free block if negative or zero
     if(size <= 0){
-        mm_free(ptr);
+        free_block(ptr);
         return 0;
     }
 
     if(ptr == NULL)
-    return mm_malloc(size);
+    return malloc_block(size);
 
     size_t copySize;
     void *newp;
-    size_t newSize = MAX(ALIGN(size) + DSIZE, OVERHEAD); //adjusted
+    size_t newSize = adjust(size); //adjusted
 
-    //get size of old block
-    copySize = GET_SIZE(HDRP(ptr));
+    //a mapped block that stays huge is resized in place by mremap, no copy
+    if(GET_MMAPPED(HDRP(ptr)) && size >= mmap_threshold){
+        size_t off = GET_SIZE(HDRP(ptr));
 
-    int difference = copySize - newSize;
+        newp = mem_remap(MAPP(ptr), size + off);
+        return newp ? map_block(newp, off) : 0;
+    }
+
+    //get size of old block
+    copySize = block_size(ptr);
 
     if(copySize == newSize)
     return ptr;
 
+    copySize -= DSIZE; //payload only
+
     if(size < copySize)
     copySize = size;
 
-    newp = mm_malloc(size); //new block allocated if needed
+    newp = malloc_block(size); //new block allocated if needed
 
     if(!newp)
     return 0;
     
     memcpy(newp, ptr, copySize); //move old date to new block
-    mm_free(ptr); //free old block
+    free_block(ptr); //free old block
     return newp;
 }
 
+/*
+ * mm_setopt - Set a tuning parameter of the package. Returns 1 on
+ *     success and 0 if the parameter or its value is not valid.
+ */
+int mm_setopt(int param, long value)
+{
+    switch (param) {
+    case MM_OPT_MMAP_THRESHOLD:
+	if (value <= 0)
+	    return 0;
+	mmap_threshold = value;
+	return 1;
+    case MM_OPT_PURGE_DECAY:
+	if (value < 0)
+	    return 0;
+	purge_decay = value;
+	return 1;
+    case MM_OPT_SPLIT_SIZE:
+	if (value < 0)
+	    return 0;
+	split_size = value;
+	return 1;
+    case MM_OPT_ADDR_ORDER:
+	if (value != 0 && value != 1)
+	    return 0;
+	addr_order = value;
+	return 1;
+    default:
+	return 0;
+    }
+}
+
+/*
+ * mm_purge - Start a new purge epoch and release the pages of every
+ *     free block that has been idle since before the previous epoch
+ *     began. Returns the number of bytes released. Calling this
+ *     periodically purges blocks idle for one to two periods.
+ */
+size_t mm_purge(void)
+{
+    size_t released;
+
+    lock();
+    ctl->purge_epoch++;
+    ctl->purge_ops = 0;
+    released = purge_old(-1);
+    unlock();
+    return released;
+}
+
+/*
+ * mm_stat - Return a statistic of the package since mm_init, or -1 if
+ *     there is no such statistic
+ */
+long mm_stat(int stat)
+{
+    switch (stat) {
+    case MM_STAT_CALLOC_BYTES:
+	return ctl->calloc_bytes;
+    case MM_STAT_CALLOC_ZERO:
+	return ctl->calloc_zero;
+    case MM_STAT_FIT_SEARCHES:
+	return ctl->fit_searches;
+    case MM_STAT_FIT_BLOCKS:
+	return ctl->fit_blocks;
+    case MM_STAT_FIT_BYTES:
+	return ctl->fit_bytes;
+    case MM_STAT_BAD_FREES:
+	return ctl->bad_frees;
+    default:
+	return -1;
+    }
+}
+
+/*
+ * mm_usable_size - Return the number of payload bytes the caller may
+ *     actually use in the allocated block bp, which can exceed the
+ *     size originally requested
+ */
+size_t mm_usable_size(void *bp)
+{
+    if (bp == NULL)
+	return 0;
+    return block_size(bp) - DSIZE;
+}
+
 /* 
  * mm_checkheap - Check the heap for consistency 
  */
 void mm_checkheap(int verbose) 
 {
-    char *bp = heap_listp;
+    char *heap_listp = TO_PTR(ctl->heap_listp);
+    char *bp;
+    unsigned int hblocks = 0;
 
     if (verbose)
 	printf("Heap (%p):\n", heap_listp);
 
-    if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp)))
+    if ((GET_SIZE(HDRP(heap_listp)) != ALIGNMENT) || !GET_ALLOC(HDRP(heap_listp)))
 	printf("Bad prologue header\n");
     checkblock(heap_listp);
 
@@ -217,12 +1425,16 @@ void mm_checkheap(int verbose)
 	if (verbose) 
 	    printblock(bp);
 	checkblock(bp);
+	if (GET_ALLOC(HDRP(bp)) && GET_HANDLE(HDRP(bp)))
+	    hblocks++;
     }
      
     if (verbose)
 	printblock(bp);
     if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
 	printf("Bad epilogue header\n");
+    checkbins();
+    checkhandles(hblocks);
 }
 
 /* The remaining routines are internal helper routines */
@@ -233,17 +1445,22 @@ void mm_checkheap(int verbose)
 /* $begin mmextendheap */
 static void *extend_heap(size_t words) 
 {
-    char *bp;
+    char *bp, *zero_lo;
     size_t size;
+    unsigned int zero;
 	
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-    if ((bp = mem_sbrk(size)) == (void *)-1) 
+    /* Allocate a multiple of ALIGNMENT to maintain alignment, and
+       never let the heap outgrow its offsets */
+    size = ALIGN(words * WSIZE);
+    zero_lo = mem_zero_lo();
+    if (size > MAX_OFFSET - mem_heapsize() || (bp = mem_sbrk(size)) == (void *)-1) 
 	return NULL;
 
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* free block header */
-    PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
+    /* Initialize free block header/footer and the epilogue header. The
+       block is known to be zero if the break never got this far. */
+    zero = (bp >= zero_lo) ? ZEROED : 0;
+    PUT(HDRP(bp), PACK(size, zero));      /* free block header */
+    PUT(FTRP(bp), PACK(size, zero));      /* free block footer */
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
 
     /* Coalesce if the previous block was free */
@@ -251,6 +1468,159 @@ static void *extend_heap(size_t words)
 }
 /* $end mmextendheap */
 
+/*
+ * adjust - Return the block size for a size-byte request: payload plus
+ *     header and footer, aligned, and rounded up to its size class when
+ *     small. The header sits just below the aligned payload and the
+ *     footer in the next block's alignment padding, so the boundary
+ *     tags cost nothing extra whenever the payload leaves 8 bytes of
+ *     padding.
+ */
+static size_t adjust(size_t size)
+{
+    size_t asize = MAX(ALIGN(size + DSIZE), OVERHEAD);
+
+    if (asize <= SIZE_CLASS_MAX)
+	asize = size_class_size[SIZE_CLASS(asize)];
+    return asize;
+}
+
+/*
+ * free_class - Return the bin of a free block: the largest class whose
+ *     requests it can hold, so that any block in bin c fits class c
+ */
+static int free_class(size_t size)
+{
+    int c = SIZE_CLASS(size);
+
+    if (c < NUM_SIZE_CLASSES - 1 && size_class_size[c] != size)
+	c--;
+    return c;
+}
+
+/*
+ * map_block - Turn the region p from mem_map or mem_remap into an
+ *     allocated block marked MMAPPED, whose block pointer is off bytes
+ *     into the region, and return the block pointer. The block spans
+ *     the rest of the region, so freeing it unmaps it. Its size may not
+ *     fit in a header, so the header holds off and block_size asks
+ *     memlib for the size.
+ */
+static void *map_block(void *p, size_t off)
+{
+    char *bp;
+
+    if (p == NULL)
+	return NULL;
+    bp = (char *)p + off;
+    PUT(HDRP(bp), PACK(off, MMAPPED | 1));
+    return bp;
+}
+
+/*
+ * block_size - Return the size of the allocated block bp
+ */
+static size_t block_size(void *bp)
+{
+    if (GET_MMAPPED(HDRP(bp)))
+	return mem_map_size(MAPP(bp)) - GET_SIZE(HDRP(bp)) + DSIZE;
+    return GET_SIZE(HDRP(bp));
+}
+
+/*
+ * lock - Take the lock of a shared heap. If a process died holding it,
+ *     the heap is taken over as it stands.
+ */
+static void lock(void)
+{
+    if (ctl->shared && pthread_mutex_lock(&ctl->lock) == EOWNERDEAD)
+	pthread_mutex_consistent(&ctl->lock);
+}
+
+/*
+ * unlock - Release the lock of a shared heap
+ */
+static void unlock(void)
+{
+    if (ctl->shared)
+	pthread_mutex_unlock(&ctl->lock);
+}
+
+/*
+ * tick - Count one request toward the current epoch, and purge at most
+ *     one expired block, so purging costs O(1) per request
+ */
+static void tick(void)
+{
+    if (purge_decay == 0)
+	return;
+    if (++ctl->purge_ops >= purge_decay) {
+	ctl->purge_ops = 0;
+	ctl->purge_epoch++;
+    }
+    purge_old(1);
+}
+
+/*
+ * purge_old - Purge up to max (or, if negative, all) of the unpurged
+ *     blocks at the tail of the large bin that were freed before the
+ *     previous epoch. In address order, look at up to max blocks from
+ *     the cursor on instead, or at all of them, and purge the ones
+ *     freed before the previous epoch. Returns the number of bytes
+ *     released.
+ */
+static size_t purge_old(int max)
+{
+    char *bp;
+    size_t released = 0;
+
+    if (ctl->addr_order) {
+	if (max < 0) {
+	    for (bp = TO_PTR(ctl->bins[NUM_SIZE_CLASSES - 1]); bp != NULL; bp = NEXT_FREE(bp))
+		if (!GET_PURGED(HDRP(bp)) && FREE_EPOCH(bp) + 1 < ctl->purge_epoch)
+		    released += purge_block(bp);
+	    return released;
+	}
+	for (; max > 0; max--) {
+	    bp = ctl->purge_cursor ? TO_PTR(ctl->purge_cursor) :
+		TO_PTR(ctl->bins[NUM_SIZE_CLASSES - 1]);
+	    if (bp == NULL)
+		break;
+	    ctl->purge_cursor = NEXT_LINK(bp);
+	    if (!GET_PURGED(HDRP(bp)) && FREE_EPOCH(bp) + 1 < ctl->purge_epoch)
+		released += purge_block(bp);
+	}
+	return released;
+    }
+
+    for (; max != 0; max--) {
+	bp = ctl->purge_cursor ? PREV_FREE(TO_PTR(ctl->purge_cursor)) :
+	    TO_PTR(ctl->large_tail);
+	if (bp == NULL || FREE_EPOCH(bp) + 1 >= ctl->purge_epoch)
+	    break;
+	released += purge_block(bp);
+	ctl->purge_cursor = TO_OFF(bp);
+    }
+    return released;
+}
+
+/*
+ * purge_block - Give the pages of free block bp between its tags and
+ *     its footer back to the system, and tag it PURGED. Returns the
+ *     number of bytes released.
+ */
+static size_t purge_block(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp)), released;
+    unsigned int tag;
+
+    released = mem_purge((char *)bp + FREE_TAGS, size - FREE_TAGS - DSIZE);
+    tag = PURGED | GET_ZEROED(HDRP(bp));
+    PUT(HDRP(bp), PACK(size, tag));
+    PUT(FTRP(bp), PACK(size, tag));
+    return released;
+}
+
 /* 
  * place - Place block of asize bytes at start of free block bp 
  *         and split if remainder would be at least minimum block size
@@ -261,14 +1631,15 @@ static void place(void *bp, size_t asize)
 /* $end mmplace-proto */
 {
     size_t csize = GET_SIZE(HDRP(bp));   
+    unsigned int zero = GET_ZEROED(HDRP(bp));
 
     if ((csize - asize) >= OVERHEAD) { 
 	    delete(bp);
 	    PUT(HDRP(bp), PACK(asize, 1));
 	    PUT(FTRP(bp), PACK(asize, 1));
 	    bp = NEXT_BLKP(bp);
-	    PUT(HDRP(bp), PACK(csize-asize, 0));
-	    PUT(FTRP(bp), PACK(csize-asize, 0));
+	    PUT(HDRP(bp), PACK(csize-asize, zero));
+	    PUT(FTRP(bp), PACK(csize-asize, zero));
 	    coalesce(bp);
     }
     else { 
@@ -279,15 +1650,76 @@ static void place(void *bp, size_t asize)
 }
 /* $end mmplace */
 
+/*
+ * place_back - Place block of asize bytes at the end of free block bp,
+ *     leaving the remainder in place, and return the block
+ */
+static void *place_back(void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    unsigned int zero = GET_ZEROED(HDRP(bp));
+
+    if ((csize - asize) < OVERHEAD) {
+	place(bp, asize);
+	return bp;
+    }
+    delete(bp);
+    PUT(HDRP(bp), PACK(csize-asize, zero));
+    PUT(FTRP(bp), PACK(csize-asize, zero));
+    add(bp);
+    bp = NEXT_BLKP(bp);
+    PUT(HDRP(bp), PACK(asize, 1));
+    PUT(FTRP(bp), PACK(asize, 1));
+    return bp;
+}
+
+/*
+ * place_aligned - Place a block of asize bytes, with its payload
+ *     aligned to align, in free block bp. The part of bp in front of
+ *     the payload becomes a free block, and place splits off the rest.
+ */
+static void *place_aligned(void *bp, size_t asize, size_t align)
+{
+    size_t lead = align_lead(bp, align);
+    size_t csize = GET_SIZE(HDRP(bp));
+    unsigned int zero = GET_ZEROED(HDRP(bp));
+    char *abp = (char *)bp + lead;
+
+    if (lead > 0) {
+	/* bp's neighbours are allocated, so neither part coalesces */
+	delete(bp);
+	PUT(HDRP(bp), PACK(lead, zero));
+	PUT(FTRP(bp), PACK(lead, zero));
+	add(bp);
+	PUT(HDRP(abp), PACK(csize - lead, zero));
+	PUT(FTRP(abp), PACK(csize - lead, zero));
+	add(abp);
+    }
+    place(abp, asize);
+    return abp;
+}
+
 /* 
- * find_fit - Find a fit for a block with asize bytes 
+ * find_fit - Find a fit for a block with asize bytes. Any block in the
+ *     bin of asize's class or a larger small class fits, so only the
+ *     bin of large blocks needs a first-fit search.
  */
 static void *find_fit(size_t asize)
 {
-    void *bp;
+    char *bp, *last = NULL;
+    int c;
+
+    for (c = SIZE_CLASS(asize); c < NUM_SIZE_CLASSES - 1; c++)
+	if (ctl->bins[c] != 0)
+	    return TO_PTR(ctl->bins[c]);
 
-    for(bp = head; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREE(bp)){                    
-		if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp)))) {
+    ctl->fit_searches++;
+    for(bp = TO_PTR(ctl->bins[NUM_SIZE_CLASSES - 1]); bp != NULL; bp = NEXT_FREE(bp)){
+		ctl->fit_blocks++;
+		if (last != NULL)
+		    ctl->fit_bytes += (bp > last) ? bp - last : last - bp;
+		last = bp;
+		if (asize <= GET_SIZE(HDRP(bp))) {
 		    return bp;
 		}
     }
@@ -295,55 +1727,146 @@ static void *find_fit(size_t asize)
 }
 
 /*
- * coalesce - boundary tag coalescing. Return ptr to coalesced block
+ * find_aligned_fit - Find a free block that can hold a block of asize
+ *     bytes with its payload aligned to align. The first block of each
+ *     bin from asize's class up is tried, then the large bin first fit.
+ */
+static void *find_aligned_fit(size_t asize, size_t align)
+{
+    void *bp;
+    int c;
+
+    for (c = SIZE_CLASS(asize); c < NUM_SIZE_CLASSES - 1; c++)
+	if ((bp = TO_PTR(ctl->bins[c])) != NULL &&
+	    align_lead(bp, align) + asize <= GET_SIZE(HDRP(bp)))
+	    return bp;
+
+    for (bp = TO_PTR(ctl->bins[NUM_SIZE_CLASSES - 1]); bp != NULL; bp = NEXT_FREE(bp))
+	if (align_lead(bp, align) + asize <= GET_SIZE(HDRP(bp)))
+	    return bp;
+    return NULL;
+}
+
+/*
+ * align_lead - Return how far into free block bp an aligned payload
+ *     can start: the next multiple of align at or after bp that leaves
+ *     either nothing or a whole free block in front of it
+ */
+static size_t align_lead(void *bp, size_t align)
+{
+    size_t lead = (((size_t)bp + align - 1) & ~(align - 1)) - (size_t)bp;
+
+    if (lead > 0 && lead < OVERHEAD)
+	lead += align;
+    return lead;
+}
+
+/*
+ * coalesce - boundary tag coalescing. Return ptr to coalesced block.
+ *     The result is still known to be zero if all its parts were, once
+ *     the tags and links between them are cleared. In address order, a
+ *     result that starts at a large free neighbour keeps its place in
+ *     the large bin, and one that swallows a large free neighbour after
+ *     it takes the neighbour's place, so neither is searched for.
  */
 static void *coalesce(void *bp) 
 {
     size_t previous_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));       
     size_t next__alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));                                 
     size_t size = GET_SIZE(HDRP(bp));          
-
-    if(previous_alloc == NULL)
-    previous_alloc = PREV_BLKP(bp) == bp;                                          
+    unsigned int zero = GET_ZEROED(HDRP(bp));
+    int placed = 0; /* bp already has its place in the large bin */
 
     if(previous_alloc && !next__alloc){     
-        delete(NEXT_BLKP(bp));                                               
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));  
-        PUT(HDRP(bp), PACK(size, 0));                                                       
-        PUT(FTRP(bp), PACK(size, 0));                                                                     
+        void *next = NEXT_BLKP(bp);
+
+        if(ctl->addr_order && size >= FREE_TAGS + DSIZE &&
+           free_class(GET_SIZE(HDRP(next))) == NUM_SIZE_CLASSES - 1){
+            relink(next, bp);
+            placed = 1;
+        }
+        else
+            delete(next);
+        size += GET_SIZE(HDRP(next));  
+        if((zero &= GET_ZEROED(HDRP(next))))
+            clear_tags(next);
+        PUT(HDRP(bp), PACK(size, zero));                                                       
+        PUT(FTRP(bp), PACK(size, zero));                                                                     
     }
     else if(!previous_alloc && next__alloc){                                                
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));                                              
-        bp = PREV_BLKP(bp);                                                              
-        delete(bp);                                                                   
-        PUT(HDRP(bp), PACK(size, 0));                                                      
-        PUT(FTRP(bp), PACK(size, 0));                                                      
+        void *prev = PREV_BLKP(bp);
+
+        size += GET_SIZE(HDRP(prev));                                              
+        if((zero &= GET_ZEROED(HDRP(prev))))
+            clear_tags(bp);
+        bp = prev;                                                              
+        if(ctl->addr_order && free_class(GET_SIZE(HDRP(bp))) == NUM_SIZE_CLASSES - 1)
+            placed = 1;
+        else
+            delete(bp);                                                                   
+        PUT(HDRP(bp), PACK(size, zero));                                                      
+        PUT(FTRP(bp), PACK(size, zero));                                                      
     }
     else if(!previous_alloc && !next__alloc){                                        
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));       
-        delete(PREV_BLKP(bp));                                                    
+        void *prev = PREV_BLKP(bp);
+
+        size += GET_SIZE(HDRP(prev)) + GET_SIZE(HDRP(NEXT_BLKP(bp)));       
+        if(ctl->addr_order && free_class(GET_SIZE(HDRP(prev))) == NUM_SIZE_CLASSES - 1)
+            placed = 1;
+        else
+            delete(prev);                                                    
         delete(NEXT_BLKP(bp));                                                    
-        bp = PREV_BLKP(bp);                                                          
-        PUT(HDRP(bp), PACK(size, 0));                                                
-        PUT(FTRP(bp), PACK(size, 0));                                                
+        if((zero &= GET_ZEROED(HDRP(prev)) & GET_ZEROED(HDRP(NEXT_BLKP(bp))))){
+            clear_tags(NEXT_BLKP(bp));
+            clear_tags(bp);
+        }
+        bp = prev;                                                          
+        PUT(HDRP(bp), PACK(size, zero));                                                
+        PUT(FTRP(bp), PACK(size, zero));                                                
     }
-    add(bp);                                                                   
+    if(placed)
+        FREE_EPOCH(bp) = ctl->purge_epoch;
+    else
+        add(bp);                                                                   
     return bp;
 }
 
 /*
- * add - add block to beginning of free list
+ * clear_tags - Clear the tags in front of free block bp and its free
+ *     list links, when bp is merged into the block before it
+ */
+static void clear_tags(void *bp)
+{
+    memset((char *)bp - DSIZE, 0, MIN(FREE_TAGS + DSIZE, GET_SIZE(HDRP(bp))));
+}
+
+/*
+ * add - add block to beginning of the free list of its size class,
+ *     stamping large blocks with the current epoch. In address order,
+ *     a large block goes in its place in the tree and the list.
  */
 static void add(void *bp){
-	PREV_FREE(bp) = NULL;
-	PREV_FREE(head) = bp;  
-    NEXT_FREE(bp) = head;                                                                                  
-    head = bp;                                                                       
+    int c = free_class(GET_SIZE(HDRP(bp)));
+
+    if(ctl->addr_order && c == NUM_SIZE_CLASSES - 1){
+        tree_insert(bp);
+        FREE_EPOCH(bp) = ctl->purge_epoch;
+        return;
+    }
+	PREV_LINK(bp) = 0;
+    NEXT_LINK(bp) = ctl->bins[c];
+    if(ctl->bins[c] != 0)
+        PREV_LINK(TO_PTR(ctl->bins[c])) = TO_OFF(bp);
+    else if(c == NUM_SIZE_CLASSES - 1)
+        ctl->large_tail = TO_OFF(bp);
+    ctl->bins[c] = TO_OFF(bp);
+    if(c == NUM_SIZE_CLASSES - 1)
+        FREE_EPOCH(bp) = ctl->purge_epoch;
 }
 
 static void printblock(void *bp) 
 {
-    size_t hsize, halloc, fsize, falloc;
+    unsigned int hsize, halloc, fsize, falloc;
 
     hsize = GET_SIZE(HDRP(bp));
     halloc = GET_ALLOC(HDRP(bp));  
@@ -355,27 +1878,239 @@ static void printblock(void *bp)
 	return;
     }
 
-    printf("%p: header: [%d:%c] footer: [%d:%c]\n", bp, 
+    printf("%p: header: [%u:%c] footer: [%u:%c]\n", bp, 
 	   hsize, (halloc ? 'a' : 'f'), 
 	   fsize, (falloc ? 'a' : 'f')); 
 }
 
 /*
- * delete - remove block to heap
+ * delete - remove block from the free list of its size class
  */
 static void delete(void *bp){
-	PREV_FREE(NEXT_FREE(bp)) = PREV_FREE(bp);
+    unsigned int off = TO_OFF(bp);
+
+    if(ctl->addr_order && free_class(GET_SIZE(HDRP(bp))) == NUM_SIZE_CLASSES - 1)
+        tree_remove(bp);
+    if(off == ctl->purge_cursor)
+        ctl->purge_cursor = NEXT_LINK(bp);
+    if(NEXT_FREE(bp) != NULL)
+        PREV_LINK(NEXT_FREE(bp)) = PREV_LINK(bp);
+    else if(off == ctl->large_tail)
+        ctl->large_tail = PREV_LINK(bp);
     if(PREV_FREE(bp) != NULL){                              
-        NEXT_FREE(PREV_FREE(bp)) = NEXT_FREE(bp); 
+        NEXT_LINK(PREV_FREE(bp)) = NEXT_LINK(bp); 
     }else{
-        head = NEXT_FREE(bp);                                                        
+        ctl->bins[free_class(GET_SIZE(HDRP(bp)))] = NEXT_LINK(bp);
     }                                      
 }
 
+/*
+ * relink - Give free block bp the place of large free block old in
+ *     the address-ordered large bin. Nothing lies between them, so
+ *     the order stays right. All of old's links are read before any
+ *     of bp's are written, as the two may overlap.
+ */
+static void relink(void *old, void *bp){
+    unsigned int o = TO_OFF(old), off = TO_OFF(bp);
+    unsigned int prev = PREV_LINK(old), next = NEXT_LINK(old);
+    unsigned int left = TREE_LEFT(old), right = TREE_RIGHT(old);
+    unsigned int up = TREE_UP(old), prio = TREE_PRIO(old);
+
+    PREV_LINK(bp) = prev;
+    NEXT_LINK(bp) = next;
+    TREE_LEFT(bp) = left;
+    TREE_RIGHT(bp) = right;
+    TREE_UP(bp) = up;
+    TREE_PRIO(bp) = prio;
+    FREE_EPOCH(bp) = ctl->purge_epoch;
+
+    if(prev)
+        NEXT_LINK(TO_PTR(prev)) = off;
+    else
+        ctl->bins[NUM_SIZE_CLASSES - 1] = off;
+    if(next)
+        PREV_LINK(TO_PTR(next)) = off;
+    else
+        ctl->large_tail = off;
+    if(up == 0)
+        ctl->large_root = off;
+    else if(TREE_LEFT(TO_PTR(up)) == o)
+        TREE_LEFT(TO_PTR(up)) = off;
+    else
+        TREE_RIGHT(TO_PTR(up)) = off;
+    if(left)
+        TREE_UP(TO_PTR(left)) = off;
+    if(right)
+        TREE_UP(TO_PTR(right)) = off;
+    if(ctl->purge_cursor == o)
+        ctl->purge_cursor = off;
+}
+
+/*
+ * tree_insert - Put large free block bp in the large bin's treap, by
+ *     address, and in the list between the blocks found to be just
+ *     below and above it on the way down
+ */
+static void tree_insert(void *bp){
+    unsigned int off = TO_OFF(bp), up = 0, prev = 0, next = 0;
+    unsigned int *link = &ctl->large_root;
+
+    while(*link != 0){
+        up = *link;
+        if(off < up){
+            next = up;
+            link = &TREE_LEFT(TO_PTR(up));
+        }
+        else{
+            prev = up;
+            link = &TREE_RIGHT(TO_PTR(up));
+        }
+    }
+    *link = off;
+    TREE_LEFT(bp) = TREE_RIGHT(bp) = 0;
+    TREE_UP(bp) = up;
+    TREE_PRIO(bp) = (off / ALIGNMENT) * 2654435761u; /* scrambled address */
+    while(TREE_UP(bp) != 0 && TREE_PRIO(bp) < TREE_PRIO(TO_PTR(TREE_UP(bp))))
+        tree_rotate_up(bp);
+
+    PREV_LINK(bp) = prev;
+    NEXT_LINK(bp) = next;
+    if(prev)
+        NEXT_LINK(TO_PTR(prev)) = off;
+    else
+        ctl->bins[NUM_SIZE_CLASSES - 1] = off;
+    if(next)
+        PREV_LINK(TO_PTR(next)) = off;
+    else
+        ctl->large_tail = off;
+}
+
+/*
+ * tree_remove - Take bp out of the large bin's treap, by rotating it
+ *     down until it has at most one child. delete unlinks the list.
+ */
+static void tree_remove(void *bp){
+    unsigned int off = TO_OFF(bp), child, up;
+    char *l, *r;
+
+    while(TREE_LEFT(bp) != 0 && TREE_RIGHT(bp) != 0){
+        l = TO_PTR(TREE_LEFT(bp));
+        r = TO_PTR(TREE_RIGHT(bp));
+        tree_rotate_up(TREE_PRIO(l) < TREE_PRIO(r) ? l : r);
+    }
+    child = TREE_LEFT(bp) ? TREE_LEFT(bp) : TREE_RIGHT(bp);
+    up = TREE_UP(bp);
+    if(child)
+        TREE_UP(TO_PTR(child)) = up;
+    if(up == 0)
+        ctl->large_root = child;
+    else if(TREE_LEFT(TO_PTR(up)) == off)
+        TREE_LEFT(TO_PTR(up)) = child;
+    else
+        TREE_RIGHT(TO_PTR(up)) = child;
+}
+
+/*
+ * tree_rotate_up - Rotate bp above its parent in the large bin's treap
+ */
+static void tree_rotate_up(void *bp){
+    unsigned int off = TO_OFF(bp), p = TREE_UP(bp), g;
+    char *pp = TO_PTR(p);
+
+    g = TREE_UP(pp);
+    if(TREE_LEFT(pp) == off){
+        TREE_LEFT(pp) = TREE_RIGHT(bp);
+        if(TREE_RIGHT(bp))
+            TREE_UP(TO_PTR(TREE_RIGHT(bp))) = p;
+        TREE_RIGHT(bp) = p;
+    }
+    else{
+        TREE_RIGHT(pp) = TREE_LEFT(bp);
+        if(TREE_LEFT(bp))
+            TREE_UP(TO_PTR(TREE_LEFT(bp))) = p;
+        TREE_LEFT(bp) = p;
+    }
+    TREE_UP(pp) = off;
+    TREE_UP(bp) = g;
+    if(g == 0)
+        ctl->large_root = off;
+    else if(TREE_LEFT(TO_PTR(g)) == p)
+        TREE_LEFT(TO_PTR(g)) = off;
+    else
+        TREE_RIGHT(TO_PTR(g)) = off;
+}
+
 static void checkblock(void *bp) 
 {
-    if ((size_t)bp % 8)
-	printf("Error: %p is not doubleword aligned\n", bp);
+    if ((size_t)bp % ALIGNMENT)
+	printf("Error: %p is not %d-byte aligned\n", bp, ALIGNMENT);
     if (GET(HDRP(bp)) != GET(FTRP(bp)))
 	printf("Error: header does not match footer\n");
+    if (!GET_ALLOC(HDRP(bp)) && GET_ZEROED(HDRP(bp))) {
+	char *p;
+
+	for (p = (char *)bp + FREE_TAGS; p < (char *)FTRP(bp); p++)
+	    if (*p != 0) {
+		printf("Error: %p is tagged zero but byte %p is not\n", bp, p);
+		break;
+	    }
+    }
+}
+
+/*
+ * checkhandles - Check that each handle's block is an allocated block
+ *     marked HANDLE, and that there are hblocks of them, one per handle
+ */
+static void checkhandles(unsigned int hblocks)
+{
+    hentry_t *tab = (hentry_t *)TO_PTR(ctl->handles);
+    unsigned int h, n = 0;
+    char *bp;
+
+    for (h = 1; h < ctl->nhandles; h++) {
+	if (tab[h].locks == HFREE)
+	    continue;
+	bp = TO_PTR(tab[h].block);
+	if (!GET_ALLOC(HDRP(bp)) || !GET_HANDLE(HDRP(bp)))
+	    printf("Error: block %p of handle %u is not a handle block\n", bp, h);
+	n++;
+    }
+    if (n != hblocks)
+	printf("Error: %u handles but %u handle blocks\n", n, hblocks);
+}
+
+/*
+ * checkbins - Check that each bin holds only free blocks of its class
+ */
+static void checkbins(void)
+{
+    void *bp;
+    int c;
+
+    for (c = 0; c < NUM_SIZE_CLASSES; c++) {
+	for (bp = TO_PTR(ctl->bins[c]); bp != NULL; bp = NEXT_FREE(bp)) {
+	    if (GET_ALLOC(HDRP(bp)))
+		printf("Error: %p in bin %d is allocated\n", bp, c);
+	    if (free_class(GET_SIZE(HDRP(bp))) != c)
+		printf("Error: %p is in bin %d instead of %d\n", bp, c,
+		       free_class(GET_SIZE(HDRP(bp))));
+	    if (NEXT_FREE(bp) != NULL && PREV_FREE(NEXT_FREE(bp)) != bp)
+		printf("Error: bad free list links at %p\n", bp);
+	    if (c == NUM_SIZE_CLASSES - 1 && NEXT_FREE(bp) == NULL &&
+		bp != TO_PTR(ctl->large_tail))
+		printf("Error: %p ends the large bin but is not its tail\n", bp);
+	    if (c == NUM_SIZE_CLASSES - 1 && !ctl->addr_order &&
+		NEXT_FREE(bp) != NULL && FREE_EPOCH(NEXT_FREE(bp)) > FREE_EPOCH(bp))
+		printf("Error: large bin out of epoch order at %p\n", bp);
+	    if (c == NUM_SIZE_CLASSES - 1 && ctl->addr_order) {
+		if (NEXT_FREE(bp) != NULL && NEXT_FREE(bp) < (char *)bp)
+		    printf("Error: large bin out of address order at %p\n", bp);
+		if ((TREE_LEFT(bp) && (TO_PTR(TREE_LEFT(bp)) >= (char *)bp ||
+				       TREE_UP(TO_PTR(TREE_LEFT(bp))) != TO_OFF(bp))) ||
+		    (TREE_RIGHT(bp) && (TO_PTR(TREE_RIGHT(bp)) <= (char *)bp ||
+					TREE_UP(TO_PTR(TREE_RIGHT(bp))) != TO_OFF(bp))))
+		    printf("Error: bad search tree links at %p\n", bp);
+	    }
+	}
+    }
 }
\ No newline at end of file
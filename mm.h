@@ -1,9 +1,73 @@
 #include <stdio.h>
 
+/* A region, whose pieces are all freed at once by mm_region_destroy */
+typedef struct mm_region mm_region_t;
+
+/* A pool of objects of one size, see mm_pool_create */
+typedef struct mm_pool mm_pool_t;
+
+/* A block that mm_compact may move, see mm_halloc; 0 is no block */
+typedef unsigned int mm_handle_t;
+
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
+extern void *mm_malloc_hint(size_t size, int hint);
 extern void mm_free (void *ptr);
+extern void mm_free_sized(void *ptr, size_t size);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **ptrs);
+extern void mm_free_batch(void **ptrs, size_t n);
+extern mm_region_t *mm_region_create(void);
+extern void *mm_region_alloc(mm_region_t *r, size_t size);
+extern void mm_region_destroy(mm_region_t *r);
+extern mm_pool_t *mm_pool_create(size_t objsize);
+extern void *mm_pool_alloc(mm_pool_t *pool);
+extern void mm_pool_free(mm_pool_t *pool, void *ptr);
+extern void mm_pool_destroy(mm_pool_t *pool);
+extern mm_handle_t mm_halloc(size_t size);
+extern void *mm_hlock(mm_handle_t h);
+extern void mm_hunlock(mm_handle_t h);
+extern void mm_hfree(mm_handle_t h);
+extern size_t mm_compact(void);
+extern size_t mm_usable_size(void *ptr);
+extern int mm_setopt(int param, long value);
+extern long mm_stat(int stat);
+extern size_t mm_purge(void);
+extern int mm_attach(void);
+extern void mm_set_root(void *ptr);
+extern void *mm_get_root(void);
+
+/* Parameters for mm_setopt */
+#define MM_OPT_MMAP_THRESHOLD 1  /* requests of at least this many bytes
+                                    get their own mapping */
+#define MM_OPT_PURGE_DECAY    2  /* requests per purge epoch, 0 = purge
+                                    only in mm_purge */
+#define MM_OPT_SPLIT_SIZE     3  /* blocks of at least this many bytes are
+                                    cut from the end of free blocks, and
+                                    smaller ones from the start; 0 = all
+                                    from the start */
+#define MM_OPT_ADDR_ORDER     4  /* 1 = keep large free blocks in address
+                                    order, 0 = newest first; takes effect
+                                    at mm_init */
+
+/* Lifetime hints for mm_malloc_hint */
+#define MM_HINT_NONE      0  /* as mm_malloc */
+#define MM_HINT_SHORT     1  /* freed again soon */
+#define MM_HINT_LONG      2  /* outlives most other blocks */
+#define MM_HINT_PERMANENT 3  /* never freed */
+
+/* Statistics for mm_stat */
+#define MM_STAT_CALLOC_BYTES  1  /* bytes requested from mm_calloc */
+#define MM_STAT_CALLOC_ZERO   2  /* of those, bytes that were known to be
+                                    zero and were not cleared */
+#define MM_STAT_FIT_SEARCHES  3  /* searches of the large free blocks */
+#define MM_STAT_FIT_BLOCKS    4  /* free blocks those searches looked at */
+#define MM_STAT_FIT_BYTES     5  /* sum of the distances between blocks
+                                    looked at one after the other */
+#define MM_STAT_BAD_FREES     6  /* bad or double frees that mm_free_sized
+                                    or mm_hfree turned down */
 
 
 /* 
@@ -0,0 +1,43 @@
+/*
+ * mm_sizeclass32.h - Size classes for mm.c built with 32-byte
+ * alignment, generated by
+ *
+ *	./mmbins -a 32 -o mm_sizeclass32.h traces/amptjp-bal.rep traces/binary-bal.rep traces/binary2-bal.rep traces/cccp-bal.rep traces/coalescing-bal.rep traces/cp-decl-bal.rep traces/expr-bal.rep traces/random-bal.rep traces/random2-bal.rep traces/realloc-bal.rep traces/realloc2-bal.rep traces/short1-bal.rep traces/short2-bal.rep
+ *
+ * Do not edit; rerun mmbins instead.
+ */
+#ifndef __MM_SIZECLASS_H_
+#define __MM_SIZECLASS_H_
+
+/* Block sizes that the tables were computed for */
+#define SIZE_CLASS_ALIGN 32
+#define SIZE_CLASS_MIN   32
+#define SIZE_CLASS_MAX   4096  /* largest small block */
+
+/* Small classes, then one class for all larger blocks */
+#define NUM_SIZE_CLASSES 16
+
+/* Block size of each small class (0: the large class) */
+static const unsigned int size_class_size[NUM_SIZE_CLASSES] = {
+    32, 96, 128, 160, 192, 480, 544, 1056,
+    1504, 1888, 2240, 2784, 3264, 3648, 4096, 0
+};
+
+/* Class of each block size up to SIZE_CLASS_MAX, by size/SIZE_CLASS_ALIGN */
+static const unsigned char size_class_index[SIZE_CLASS_MAX/SIZE_CLASS_ALIGN + 1] = {
+    0, 0, 1, 1, 2, 3, 4, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 10, 10, 10, 10,
+    10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+    11, 11, 11, 11, 11, 11, 11, 11, 12, 12, 12, 12, 12, 12, 12, 12,
+    12, 12, 12, 12, 12, 12, 12, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+    13, 13, 13, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14
+};
+
+/* The smallest class whose blocks have at least size bytes */
+#define SIZE_CLASS(size) ((size) > SIZE_CLASS_MAX ? NUM_SIZE_CLASSES - 1 : \
+    size_class_index[((size) + SIZE_CLASS_ALIGN - 1) / SIZE_CLASS_ALIGN])
+
+#endif /* __MM_SIZECLASS_H_ */
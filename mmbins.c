@@ -0,0 +1,362 @@
+/*
+ * mmbins.c - Size-class table generator for mm.c.
+ *
+ * Reads a corpus of traces and chooses the size classes that mm.c
+ * rounds small requests up to. Every request is first turned into the
+ * block size mm.c would give it (payload plus the boundary-tag
+ * overhead, aligned, at least the minimum block). Then
+ *   - the largest "small" block size is the smallest size that covers
+ *     the -c fraction of all requests (at most -t bytes); bigger blocks
+ *     are not rounded and live in a single "large" class,
+ *   - class 0 holds only minimum-sized blocks, so that every free block
+ *     belongs to some class,
+ *   - the remaining small classes are the ones that minimize the bytes
+ *     lost to rounding up, summed over all requests of the corpus. This
+ *     is an optimal 1-D quantization, solved exactly by dynamic
+ *     programming (with divide-and-conquer over the monotone split
+ *     points).
+ * The result is written as a C header with the class sizes and an
+ * array that maps a block size to its class in one lookup. mm.c has
+ * one header per alignment it can be built with; the mm_sizeclass*.h
+ * in this directory were made from the -bal traces by
+ *
+ *	unix> make sizeclasses
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "trace.h"
+
+/* Misc */
+#define DEF_CLASSES     16  /* default number of classes, large one included */
+#define DEF_COVERAGE  0.99  /* default fraction of requests in small classes */
+#define DEF_MAXSMALL  4096  /* default cap on the largest small block size */
+#define DEF_ALIGN        8  /* mm.c's block alignment */
+#define DEF_OVERHEAD     8  /* mm.c's header and footer */
+#define DEF_MINBLOCK    16  /* mm.c's minimum block size, if above -a */
+#define INF      (1e300)
+
+/* Global variables */
+static int nclasses = DEF_CLASSES;       /* -n */
+static double coverage = DEF_COVERAGE;   /* -c */
+static long maxsmall = DEF_MAXSMALL;     /* -t */
+static long align = DEF_ALIGN;           /* -a */
+static long overhead = DEF_OVERHEAD;     /* -O */
+static long minblock;                    /* -m, 0 = default */
+
+static long long *counts;     /* requests per block size / align, up to maxsmall */
+static long long nlarge;      /* requests bigger than maxsmall */
+
+/* Candidate class sizes and their prefix sums, for cost() */
+static long *v;
+static double *pre_count, *pre_bytes;
+
+/* function prototypes for internal helper routines */
+static void read_corpus(char *path);
+static double cost(int a, int b);
+static void solve(double *prev, double *cur, int *choice,
+		  int lo, int hi, int optlo, int opthi);
+static void write_header(FILE *fp, long *bounds, int nsmall, int argc, char **argv);
+static void usage(void);
+static void app_error(char *msg);
+static void unix_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    char c;
+    char *outfile = NULL;
+    FILE *fp = stdout;
+    int i, j, k, n, nsmall, first;
+    long s, top;
+    long long total, covered;
+    double *prev, *cur, waste, bytes;
+    int *choice;
+    long *bounds;
+
+    while ((c = getopt(argc, argv, "o:n:c:t:a:O:m:h")) != EOF) {
+	switch (c) {
+	case 'o': /* Output header */
+	    outfile = optarg;
+	    break;
+	case 'n': /* Number of classes */
+	    nclasses = atoi(optarg);
+	    break;
+	case 'c': /* Fraction of requests in small classes */
+	    coverage = atof(optarg);
+	    break;
+	case 't': /* Cap on the largest small block */
+	    maxsmall = atol(optarg);
+	    break;
+	case 'a': /* Block alignment */
+	    align = atol(optarg);
+	    break;
+	case 'O': /* Per-block overhead */
+	    overhead = atol(optarg);
+	    break;
+	case 'm': /* Minimum block size */
+	    minblock = atol(optarg);
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (minblock == 0)
+	minblock = (align > DEF_MINBLOCK) ? align : DEF_MINBLOCK;
+    if (optind == argc || nclasses < 3 || nclasses > 255 || align < 1 ||
+	(align & (align - 1)) || minblock % align || maxsmall < minblock) {
+	usage();
+	exit(1);
+    }
+    maxsmall -= maxsmall % align;
+
+    /* Histogram of block sizes over the whole corpus */
+    if ((counts = calloc(maxsmall / align + 1, sizeof(long long))) == NULL)
+	unix_error("calloc failed");
+    for (i = optind; i < argc; i++)
+	read_corpus(argv[i]);
+
+    /* The top small class is the size that covers enough requests */
+    for (total = nlarge, s = minblock; s <= maxsmall; s += align)
+	total += counts[s / align];
+    if (total == 0)
+	app_error("no requests in the corpus");
+    covered = counts[minblock / align];
+    for (top = minblock; top < maxsmall && covered < coverage * total; ) {
+	top += align;
+	covered += counts[top / align];
+    }
+
+    /* Candidates: the observed sizes above the minimum block, plus top */
+    if ((v = malloc((top / align + 1) * sizeof(long))) == NULL ||
+	(pre_count = malloc((top / align + 2) * sizeof(double))) == NULL ||
+	(pre_bytes = malloc((top / align + 2) * sizeof(double))) == NULL)
+	unix_error("malloc failed");
+    n = 0;
+    pre_count[0] = pre_bytes[0] = 0;
+    for (s = minblock + align; s <= top; s += align) {
+	if (counts[s / align] == 0 && s != top)
+	    continue;
+	v[n] = s;
+	pre_count[n + 1] = pre_count[n] + counts[s / align];
+	pre_bytes[n + 1] = pre_bytes[n] + (double)counts[s / align] * s;
+	n++;
+    }
+
+    /* Choose nsmall class sizes among the n candidates */
+    nsmall = (n < nclasses - 2) ? n : nclasses - 2;
+    if ((bounds = malloc((nsmall + 1) * sizeof(long))) == NULL)
+	unix_error("malloc failed");
+    bounds[0] = minblock;
+    if (nsmall > 0) {
+	if ((prev = malloc(n * sizeof(double))) == NULL ||
+	    (cur = malloc(n * sizeof(double))) == NULL ||
+	    (choice = malloc((size_t)nsmall * n * sizeof(int))) == NULL)
+	    unix_error("malloc failed");
+
+	/* One class covering candidates 0..j costs cost(0, j) */
+	for (j = 0; j < n; j++) {
+	    cur[j] = cost(0, j);
+	    choice[j] = -1;
+	}
+	/* k+1 classes: the last one covers choice+1..j */
+	for (k = 1; k < nsmall; k++) {
+	    memcpy(prev, cur, n * sizeof(double));
+	    solve(prev, cur, choice + (size_t)k * n, 0, n - 1, 0, n - 1);
+	}
+
+	/* Walk back from the forced top class */
+	for (k = nsmall - 1, j = n - 1; k >= 0; k--) {
+	    bounds[k + 1] = v[j];
+	    j = choice[(size_t)k * n + j];
+	}
+	free(prev);
+	free(cur);
+	free(choice);
+    }
+
+    /* Report the rounding loss of the chosen classes */
+    waste = bytes = 0;
+    for (k = 0, first = 0; k <= nsmall; k++) {
+	for (j = first; j < n && v[j] <= bounds[k]; j++)
+	    ;
+	if (k > 0) {
+	    waste += cost(first, j - 1);
+	    bytes += pre_bytes[j] - pre_bytes[first];
+	}
+	first = j;
+    }
+    printf("%d classes, small blocks up to %ld bytes cover %.2f%% of %lld requests\n",
+	   nsmall + 2, top, 100.0 * covered / total, total);
+    printf("Rounding to the classes wastes %.2f%% of the small block bytes\n",
+	   bytes > 0 ? 100.0 * waste / bytes : 0.0);
+
+    if (outfile != NULL && (fp = fopen(outfile, "w")) == NULL)
+	unix_error("Could not create output header");
+    write_header(fp, bounds, nsmall + 1, argc, argv);
+    if (fp != stdout && fclose(fp) == EOF)
+	unix_error("Could not write output header");
+    exit(0);
+}
+
+/*
+ * read_corpus - Add the block sizes of every alloc and realloc
+ *     request in the trace at path to the histogram
+ */
+static void read_corpus(char *path)
+{
+    tracefile_t *tf;
+    traceop_t op;
+    long asize;
+    int rc;
+
+    if ((tf = trace_open(path)) == NULL) {
+	fprintf(stderr, "Could not open trace %s: %s\n", path, strerror(errno));
+	exit(1);
+    }
+    while ((rc = trace_next(tf, &op)) == 1) {
+	if (op.type == FREE)
+	    continue;
+	asize = (op.size + overhead + align - 1) & ~(align - 1);
+	asize = (asize < minblock) ? minblock : asize;
+	if (asize > maxsmall)
+	    nlarge++;
+	else
+	    counts[asize / align]++;
+    }
+    trace_close(tf);
+    if (rc < 0)
+	exit(1);
+}
+
+/*
+ * cost - Bytes lost by rounding candidates a..b up to v[b]
+ */
+static double cost(int a, int b)
+{
+    if (a > b)
+	return 0;
+    return v[b] * (pre_count[b + 1] - pre_count[a]) -
+	(pre_bytes[b + 1] - pre_bytes[a]);
+}
+
+/*
+ * solve - Fill cur[lo..hi] with the least cost of covering candidates
+ *     0..j with one more class than prev did, recording in choice[j]
+ *     the last candidate of the previous class. The best split point
+ *     never decreases with j, so each half only searches its side of
+ *     the split found for the midpoint.
+ */
+static void solve(double *prev, double *cur, int *choice,
+		  int lo, int hi, int optlo, int opthi)
+{
+    int i, mid, best = -1;
+    double c, bestc = INF;
+
+    if (lo > hi)
+	return;
+    mid = (lo + hi) / 2;
+    for (i = optlo; i <= opthi && i < mid; i++) {
+	if (prev[i] >= INF)
+	    continue;
+	c = prev[i] + cost(i + 1, mid);
+	if (c < bestc) {
+	    bestc = c;
+	    best = i;
+	}
+    }
+    cur[mid] = bestc;
+    choice[mid] = best;
+    solve(prev, cur, choice, lo, mid - 1, optlo, (best < 0) ? opthi : best);
+    solve(prev, cur, choice, mid + 1, hi, (best < 0) ? optlo : best, opthi);
+}
+
+/*
+ * write_header - Write the class sizes and the lookup array as C
+ */
+static void write_header(FILE *fp, long *bounds, int nsmall, int argc, char **argv)
+{
+    int i, k;
+    long s, top = bounds[nsmall - 1];
+
+    fprintf(fp, "/*\n * mm_sizeclass%ld.h - Size classes for mm.c built with %ld-byte\n"
+	    " * alignment, generated by\n *\n *\t", align, align);
+    for (i = 0; i < argc; i++)
+	fprintf(fp, "%s%s", argv[i], (i + 1 < argc) ? " " : "\n");
+    fprintf(fp, " *\n * Do not edit; rerun mmbins instead.\n */\n");
+    fprintf(fp, "#ifndef __MM_SIZECLASS_H_\n#define __MM_SIZECLASS_H_\n\n");
+    fprintf(fp, "/* Block sizes that the tables were computed for */\n");
+    fprintf(fp, "#define SIZE_CLASS_ALIGN %ld\n", align);
+    fprintf(fp, "#define SIZE_CLASS_MIN   %ld\n", minblock);
+    fprintf(fp, "#define SIZE_CLASS_MAX   %ld  /* largest small block */\n\n", top);
+    fprintf(fp, "/* Small classes, then one class for all larger blocks */\n");
+    fprintf(fp, "#define NUM_SIZE_CLASSES %d\n\n", nsmall + 1);
+
+    fprintf(fp, "/* Block size of each small class (0: the large class) */\n");
+    fprintf(fp, "static const unsigned int size_class_size[NUM_SIZE_CLASSES] = {");
+    for (k = 0; k < nsmall; k++)
+	fprintf(fp, "%s%ld,", (k % 8) ? " " : "\n    ", bounds[k]);
+    fprintf(fp, "%s0\n};\n\n", (k % 8) ? " " : "\n    ");
+
+    fprintf(fp, "/* Class of each block size up to SIZE_CLASS_MAX, by size/SIZE_CLASS_ALIGN */\n");
+    fprintf(fp, "static const unsigned char size_class_index[SIZE_CLASS_MAX/SIZE_CLASS_ALIGN + 1] = {");
+    for (s = 0, k = 0, i = 0; s <= top; s += align, i++) {
+	while (bounds[k] < s)
+	    k++;
+	fprintf(fp, "%s%d%s", (i % 16) ? " " : "\n    ", k, (s < top) ? "," : "");
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "/* The smallest class whose blocks have at least size bytes */\n");
+    fprintf(fp, "#define SIZE_CLASS(size) ((size) > SIZE_CLASS_MAX ? NUM_SIZE_CLASSES - 1 : \\\n");
+    fprintf(fp, "    size_class_index[((size) + SIZE_CLASS_ALIGN - 1) / SIZE_CLASS_ALIGN])\n\n");
+    fprintf(fp, "#endif /* __MM_SIZECLASS_H_ */\n");
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmbins [-h] [-o <header>] [-n <classes>] [-c <fraction>] [-t <bytes>]\n");
+    fprintf(stderr, "              [-a <align>] [-O <bytes>] [-m <bytes>] <trace>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-a <align>    Block alignment (default %d).\n", DEF_ALIGN);
+    fprintf(stderr, "\t-c <fraction> Requests that must get a small class (default %.2f).\n",
+	    DEF_COVERAGE);
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-m <bytes>    Minimum block size (default %d or <align>).\n",
+	    DEF_MINBLOCK);
+    fprintf(stderr, "\t-n <classes>  Number of classes, 3 to 255 (default %d).\n", DEF_CLASSES);
+    fprintf(stderr, "\t-o <header>   Output header (default stdout).\n");
+    fprintf(stderr, "\t-O <bytes>    Per-block overhead (default %d).\n", DEF_OVERHEAD);
+    fprintf(stderr, "\t-t <bytes>    Largest small block size allowed (default %d).\n",
+	    DEF_MAXSMALL);
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
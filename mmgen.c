@@ -0,0 +1,557 @@
+/*
+ * mmgen.c - Synthetic workload generator for the malloc lab driver.
+ *
+ * Writes a trace file of any length with a controlled request size
+ * distribution, object lifetimes, realloc growth chains and live-set
+ * size. The same options and seed always produce the same trace.
+ *
+ *	unix> mmgen -n 100000000 -d pow:1.5:16:65536 -l exp:5000 \
+ *		    -L 1073741824 -s 7 -b -o big.rep
+ *
+ * At each step the generator, in this order,
+ *   1. frees the block with the earliest death time if it is due,
+ *   2. frees it anyway if the live payload has reached the -L target,
+ *   3. with probability -r extends a realloc chain: the block touched
+ *      by the last realloc is resized by the growth factor, or a new
+ *      chain is started on a random live block that has never been
+ *      resized. A chain ends after the given number of reallocs, so no
+ *      block grows by more than factor^len.
+ *   4. otherwise allocates a new block whose size is drawn from the -d
+ *      distribution and whose death time comes from the -l model. With
+ *      probability -a the block is requested aligned, as by memalign,
+ *      and with probability -c zeroed, as by calloc.
+ * Once only enough requests remain to free the live blocks, they are
+ * all freed, so traces are balanced like the *-bal.rep files (unless
+ * -u is given). Ids of freed blocks are reused, keeping num_ids near
+ * the peak number of live blocks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+
+#include "trace.h"
+#include "mm.h"
+
+/* Misc */
+#define MAXLINE    1024       /* max string size */
+#define NEVER      1e300      /* death time of blocks that outlive the run */
+
+/* Size distributions */
+#define DIST_POW   0  /* truncated power law on [min, max] with exponent alpha */
+#define DIST_BI    1  /* size1 with probability p, else size2 */
+#define DIST_EMP   2  /* drawn from a "size count" histogram file */
+
+/* Lifetime models */
+#define LIFE_EXP   0  /* exponentially distributed, given mean (in requests) */
+#define LIFE_PHASE 1  /* die at the end of the phase they were born in */
+
+/* A live block */
+typedef struct {
+    double death;  /* request number at which the block is freed */
+    int id;
+} block_t;
+
+/* Global variables */
+static unsigned long long rng_state;  /* splitmix64 state */
+
+static int dist = DIST_POW;
+static double pow_alpha = 1.5, pow_min = 8, pow_max = 4096;
+static double bi_size1 = 16, bi_size2 = 4096, bi_p = 0.9;
+static double *emp_size, *emp_cdf;   /* empirical sizes, cumulative weights */
+static int emp_n;
+
+static int life = LIFE_EXP;
+static double life_mean = 1000;      /* LIFE_EXP */
+static double phase_len = 10000;     /* LIFE_PHASE */
+static double phase_keep = 0;        /* fraction of blocks outliving phases */
+
+static double realloc_p = 0;         /* probability of a realloc */
+static double realloc_factor = 1.5;  /* size ratio of each realloc */
+static int realloc_chain = 8;        /* reallocs in each chain */
+
+static double memalign_p = 0;        /* probability that an alloc is aligned */
+static int memalign_align = 64;      /* alignment of those allocs */
+static double calloc_p = 0;          /* probability that an alloc is calloc */
+static double hint_ops = 0;          /* hint blocks dying within this many
+					requests as short, 0 = no hints */
+
+/* The live blocks, as a min-heap on death time... */
+static block_t *heap;
+static int nlive, heap_cap;
+/* ... and per id: size, position in live_ids and the live ids themselves */
+static int *id_size, *id_pos, *live_ids;
+static unsigned char *id_grown;     /* nonzero once the block was resized */
+static int id_cap;
+static int *free_ids, nfree;        /* ids available for reuse */
+static int next_id;
+
+/* function prototypes for internal helper routines */
+static unsigned long long rng_next(void);
+static double rng_uniform(void);
+static int draw_size(void);
+static double draw_death(double now);
+static int new_id(void);
+static void heap_push(double death, int id);
+static block_t heap_pop(void);
+static void live_add(int id);
+static void live_del(int id);
+static void parse_dist(char *arg);
+static void parse_life(char *arg);
+static void read_histogram(char *path);
+static void emit(tracefile_t *tf, int type, int id, int size, int hint);
+static void usage(void);
+static void app_error(char *msg);
+static void unix_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    char c;
+    char *outfile = NULL;
+    int binary = 0;             /* write the binary trace format (-b) */
+    int balanced = 1;           /* free everything at the end (reset by -u) */
+    long long num_ops = 100000; /* requests to generate (-n) */
+    double live_target = 0;     /* max live payload bytes, 0 = no limit (-L) */
+    unsigned long long seed = 1;
+
+    tracefile_t *tf;
+    long long done = 0;         /* requests written so far */
+    double live_bytes = 0, peak_bytes = 0;
+    int chain = -1;             /* id being resized by the current chain */
+    int chain_left = 0;         /* reallocs left in the current chain */
+    block_t b;
+    int id, size, full, hint;
+    double newsize, death;
+
+    while ((c = getopt(argc, argv, "o:bun:s:d:l:r:a:c:L:H:h")) != EOF) {
+	switch (c) {
+	case 'o': /* Output trace file */
+	    outfile = optarg;
+	    break;
+	case 'b': /* Binary output */
+	    binary = 1;
+	    break;
+	case 'u': /* Leave blocks live at the end */
+	    balanced = 0;
+	    break;
+	case 'n': /* Number of requests */
+	    num_ops = strtoll(optarg, NULL, 0);
+	    break;
+	case 's': /* Random seed */
+	    seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'd': /* Size distribution */
+	    parse_dist(optarg);
+	    break;
+	case 'l': /* Lifetime model */
+	    parse_life(optarg);
+	    break;
+	case 'r': /* Realloc probability and growth factor */
+	    if (sscanf(optarg, "%lf:%lf:%d", &realloc_p, &realloc_factor,
+		       &realloc_chain) < 1 || realloc_chain < 1)
+		app_error("bad -r argument");
+	    break;
+	case 'a': /* Memalign probability and alignment */
+	    if (sscanf(optarg, "%lf:%d", &memalign_p, &memalign_align) < 1 ||
+		memalign_align < 1 || (memalign_align & (memalign_align - 1)))
+		app_error("bad -a argument");
+	    break;
+	case 'c': /* Calloc probability */
+	    calloc_p = strtod(optarg, NULL);
+	    break;
+	case 'L': /* Target live-set size */
+	    live_target = strtod(optarg, NULL);
+	    break;
+	case 'H': /* Lifetime hints */
+	    hint_ops = strtod(optarg, NULL);
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (outfile == NULL || num_ops <= 0 || num_ops > INT_MAX) {
+	usage();
+	exit(1);
+    }
+
+    rng_state = seed;
+    if ((tf = trace_create(outfile, binary)) == NULL)
+	unix_error("Could not create output trace");
+
+    while (done + (balanced ? nlive : 0) < num_ops) {
+	/* Without room for one more alloc and its free, only free */
+	full = balanced && done + nlive + 2 > num_ops;
+	if (full && nlive == 0)
+	    break;
+	if (nlive > 0 && (full || heap[0].death <= done ||
+			  (live_target > 0 && live_bytes >= live_target))) {
+	    /* Free the block that is due, or the next one to come due */
+	    b = heap_pop();
+	    live_del(b.id);
+	    live_bytes -= id_size[b.id];
+	    emit(tf, FREE, b.id, 0, MM_HINT_NONE);
+	    free_ids[nfree++] = b.id;
+	    if (b.id == chain)
+		chain = -1;
+	}
+	else if (nlive > 0 && realloc_p > 0 && rng_uniform() < realloc_p &&
+		 (chain >= 0 || !id_grown[id = live_ids[rng_next() % nlive]])) {
+	    /* Extend the current realloc chain, or start a new one */
+	    if (chain < 0) {
+		chain = id;
+		chain_left = realloc_chain;
+		id_grown[chain] = 1;
+	    }
+	    newsize = id_size[chain] * realloc_factor;
+	    size = (newsize < 1) ? 1 : (newsize > INT_MAX) ? INT_MAX : (int)newsize;
+	    live_bytes += size - id_size[chain];
+	    id_size[chain] = size;
+	    emit(tf, REALLOC, chain, size, MM_HINT_NONE);
+	    if (--chain_left == 0)
+		chain = -1;
+	}
+	else {
+	    /* Allocate a new block */
+	    id = new_id();
+	    size = draw_size();
+	    id_size[id] = size;
+	    live_bytes += size;
+	    live_add(id);
+	    death = draw_death(done);
+	    heap_push(death, id);
+	    hint = MM_HINT_NONE;
+	    if (hint_ops > 0)
+		hint = (death == NEVER) ? MM_HINT_PERMANENT :
+		    (death - done <= hint_ops) ? MM_HINT_SHORT : MM_HINT_LONG;
+	    emit(tf, (memalign_p > 0 && rng_uniform() < memalign_p) ? MEMALIGN :
+		 (calloc_p > 0 && rng_uniform() < calloc_p) ? CALLOC : ALLOC,
+		 id, size, hint);
+	}
+	done++;
+	peak_bytes = (live_bytes > peak_bytes) ? live_bytes : peak_bytes;
+    }
+
+    /* Free whatever is still live */
+    while (balanced && nlive > 0) {
+	b = heap_pop();
+	live_del(b.id);
+	emit(tf, FREE, b.id, 0, MM_HINT_NONE);
+	done++;
+    }
+
+    tf->sugg_heapsize = (peak_bytes > INT_MAX) ? INT_MAX : (int)peak_bytes;
+    if (trace_close(tf) < 0)
+	unix_error("Could not write output trace");
+    printf("%s: %lld ops, %d ids, peak live %.0f bytes\n",
+	   outfile, done, next_id, peak_bytes);
+    exit(0);
+}
+
+/*
+ * rng_next - splitmix64, a small generator that is fully determined
+ *     by its seed on every platform
+ */
+static unsigned long long rng_next(void)
+{
+    unsigned long long z = (rng_state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * rng_uniform - Return a double uniformly distributed in [0, 1)
+ */
+static double rng_uniform(void)
+{
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * draw_size - Draw a request size from the chosen distribution
+ */
+static int draw_size(void)
+{
+    double u = rng_uniform(), s, a, b;
+    int lo, hi, mid;
+
+    switch (dist) {
+    case DIST_POW:
+	/* inverse CDF of the power law truncated to [pow_min, pow_max] */
+	a = pow(pow_min, -pow_alpha);
+	b = pow(pow_max, -pow_alpha);
+	s = pow(a - u * (a - b), -1.0 / pow_alpha);
+	break;
+    case DIST_BI:
+	s = (u < bi_p) ? bi_size1 : bi_size2;
+	break;
+    default: /* DIST_EMP: binary search of the cumulative weights */
+	u *= emp_cdf[emp_n - 1];
+	for (lo = 0, hi = emp_n - 1; lo < hi; ) {
+	    mid = (lo + hi) / 2;
+	    if (emp_cdf[mid] <= u)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	s = emp_size[lo];
+	break;
+    }
+    return (s < 1) ? 1 : (s > INT_MAX) ? INT_MAX : (int)s;
+}
+
+/*
+ * draw_death - Draw the death time of a block allocated at request now
+ */
+static double draw_death(double now)
+{
+    double u;
+
+    if (life == LIFE_EXP) {
+	u = rng_uniform();
+	return now + 1 - life_mean * log(1.0 - u);
+    }
+    if (phase_keep > 0 && rng_uniform() < phase_keep)
+	return NEVER;
+    return (floor(now / phase_len) + 1) * phase_len;
+}
+
+/*
+ * new_id - Return an unused id, preferring one freed earlier
+ */
+static int new_id(void)
+{
+    int id;
+
+    if (nfree > 0) {
+	id = free_ids[--nfree];
+	id_grown[id] = 0;
+	return id;
+    }
+    if (next_id == id_cap) {
+	id_cap = id_cap ? 2 * id_cap : 1024;
+	if ((id_size = realloc(id_size, id_cap * sizeof(int))) == NULL ||
+	    (id_pos = realloc(id_pos, id_cap * sizeof(int))) == NULL ||
+	    (live_ids = realloc(live_ids, id_cap * sizeof(int))) == NULL ||
+	    (free_ids = realloc(free_ids, id_cap * sizeof(int))) == NULL ||
+	    (id_grown = realloc(id_grown, id_cap)) == NULL)
+	    unix_error("realloc failed in new_id");
+    }
+    id_grown[next_id] = 0;
+    return next_id++;
+}
+
+/*
+ * heap_push - Insert a block into the death-time heap. Called after
+ *     live_add, so the heap grows to nlive entries.
+ */
+static void heap_push(double death, int id)
+{
+    int i, parent;
+
+    if (nlive > heap_cap) {
+	heap_cap = heap_cap ? 2 * heap_cap : 1024;
+	if ((heap = realloc(heap, heap_cap * sizeof(block_t))) == NULL)
+	    unix_error("realloc failed in heap_push");
+    }
+    for (i = nlive - 1; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (heap[parent].death <= death)
+	    break;
+	heap[i] = heap[parent];
+    }
+    heap[i].death = death;
+    heap[i].id = id;
+}
+
+/*
+ * heap_pop - Remove and return the block with the earliest death time.
+ *     Called before live_del, so the heap shrinks to nlive-1 entries.
+ */
+static block_t heap_pop(void)
+{
+    block_t top = heap[0], last = heap[nlive - 1];
+    int i, child, n = nlive - 1;
+
+    for (i = 0; (child = 2*i + 1) < n; i = child) {
+	if (child + 1 < n && heap[child + 1].death < heap[child].death)
+	    child++;
+	if (last.death <= heap[child].death)
+	    break;
+	heap[i] = heap[child];
+    }
+    heap[i] = last;
+    return top;
+}
+
+/*
+ * live_add - Record id as live, for the random choice of realloc chains
+ */
+static void live_add(int id)
+{
+    id_pos[id] = nlive;
+    live_ids[nlive++] = id;
+}
+
+/*
+ * live_del - Remove id from the live set
+ */
+static void live_del(int id)
+{
+    int last = live_ids[--nlive];
+
+    live_ids[id_pos[id]] = last;
+    id_pos[last] = id_pos[id];
+}
+
+/*
+ * parse_dist - Parse a -d argument: pow:<alpha>:<min>:<max>,
+ *     bi:<size1>:<size2>:<p1> or emp:<histogram file>
+ */
+static void parse_dist(char *arg)
+{
+    if (!strncmp(arg, "pow:", 4)) {
+	dist = DIST_POW;
+	if (sscanf(arg + 4, "%lf:%lf:%lf", &pow_alpha, &pow_min, &pow_max) != 3 ||
+	    pow_alpha <= 0 || pow_min < 1 || pow_max < pow_min)
+	    app_error("bad -d pow argument");
+    }
+    else if (!strncmp(arg, "bi:", 3)) {
+	dist = DIST_BI;
+	if (sscanf(arg + 3, "%lf:%lf:%lf", &bi_size1, &bi_size2, &bi_p) != 3)
+	    app_error("bad -d bi argument");
+    }
+    else if (!strncmp(arg, "emp:", 4)) {
+	dist = DIST_EMP;
+	read_histogram(arg + 4);
+    }
+    else
+	app_error("unknown size distribution");
+}
+
+/*
+ * parse_life - Parse a -l argument: exp:<mean> or
+ *     phase:<length>[:<fraction kept to the end>]
+ */
+static void parse_life(char *arg)
+{
+    if (!strncmp(arg, "exp:", 4)) {
+	life = LIFE_EXP;
+	if (sscanf(arg + 4, "%lf", &life_mean) != 1 || life_mean <= 0)
+	    app_error("bad -l exp argument");
+    }
+    else if (!strncmp(arg, "phase:", 6)) {
+	life = LIFE_PHASE;
+	if (sscanf(arg + 6, "%lf:%lf", &phase_len, &phase_keep) < 1 ||
+	    phase_len < 1)
+	    app_error("bad -l phase argument");
+    }
+    else
+	app_error("unknown lifetime model");
+}
+
+/*
+ * read_histogram - Read "size count" lines for the empirical
+ *     distribution, as printed by mmprof -e
+ */
+static void read_histogram(char *path)
+{
+    FILE *fp;
+    char line[MAXLINE];
+    double size, count, total = 0;
+    int cap = 0;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	unix_error("Could not open histogram file");
+    while (fgets(line, MAXLINE, fp) != NULL) {
+	if (line[0] == '#' || sscanf(line, "%lf %lf", &size, &count) != 2 ||
+	    count <= 0)
+	    continue;
+	if (emp_n == cap) {
+	    cap = cap ? 2 * cap : 256;
+	    if ((emp_size = realloc(emp_size, cap * sizeof(double))) == NULL ||
+		(emp_cdf = realloc(emp_cdf, cap * sizeof(double))) == NULL)
+		unix_error("realloc failed in read_histogram");
+	}
+	total += count;
+	emp_size[emp_n] = size;
+	emp_cdf[emp_n++] = total;
+    }
+    fclose(fp);
+    if (emp_n == 0)
+	app_error("empty histogram file");
+}
+
+/*
+ * emit - Append one request to the output trace
+ */
+static void emit(tracefile_t *tf, int type, int id, int size, int hint)
+{
+    traceop_t op;
+
+    op.type = type;
+    op.index = id;
+    op.size = size;
+    op.align = memalign_align;
+    op.hint = hint;
+    if (trace_put(tf, &op) < 0)
+	unix_error("Could not write output trace");
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmgen [-hbu] -o <file> [-n <ops>] [-s <seed>] [-d <dist>]\n");
+    fprintf(stderr, "             [-l <life>] [-r <p>[:<factor>[:<len>]]] [-a <p>[:<align>]]\n");
+    fprintf(stderr, "             [-c <p>] [-L <bytes>] [-H <ops>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-a <p>[:<align>] Request a new block aligned with probability\n");
+    fprintf(stderr, "\t           <p>, to <align> bytes (default 64).\n");
+    fprintf(stderr, "\t-b         Write the binary trace format.\n");
+    fprintf(stderr, "\t-c <p>     Request a new block zeroed with probability <p>.\n");
+    fprintf(stderr, "\t-d <dist>  Sizes: pow:<alpha>:<min>:<max> (default pow:1.5:8:4096),\n");
+    fprintf(stderr, "\t           bi:<size1>:<size2>:<p1>, emp:<histogram file>.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <ops>   Give each block a lifetime hint: short if it is freed\n");
+    fprintf(stderr, "\t           within <ops> requests, permanent if never, else long.\n");
+    fprintf(stderr, "\t-l <life>  Lifetimes: exp:<mean ops> (default exp:1000),\n");
+    fprintf(stderr, "\t           phase:<len>[:<fraction kept to the end>].\n");
+    fprintf(stderr, "\t-L <bytes> Free early to keep the live payload below <bytes>.\n");
+    fprintf(stderr, "\t-n <ops>   Number of requests (default 100000).\n");
+    fprintf(stderr, "\t-o <file>  Output trace file.\n");
+    fprintf(stderr, "\t-r <p>[:<factor>[:<len>]] Realloc chains: probability, growth\n");
+    fprintf(stderr, "\t           factor (default 1.5) and length (default 8).\n");
+    fprintf(stderr, "\t-s <seed>  Random seed (default 1).\n");
+    fprintf(stderr, "\t-u         Don't free the blocks still live at the end.\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
@@ -0,0 +1,487 @@
+/*
+ * mmprof.c - Trace profiler for the malloc lab.
+ *
+ * Reads each trace named on the command line in a single streaming
+ * pass, so traces with hundreds of millions of requests need memory
+ * only in proportion to their number of ids, and reports
+ *   - histograms of request sizes and block lifetimes (in requests),
+ *     in power-of-two buckets,
+ *   - the number of live blocks and live payload bytes over time,
+ *   - the lengths of realloc chains (reallocs between alloc and free),
+ *   - the peak number of concurrent live blocks in each size bucket,
+ *   - upper bounds on the util that mdriver can report for the trace.
+ *
+ * mdriver's util is the peak live payload divided by the final heap
+ * size. No allocator can keep the heap smaller than the peak of the
+ * live blocks' total footprint, so the peak payload divided by that
+ * peak bounds the util: once with each block padded to ALIGNMENT, and
+ * once also with the per-block overhead and minimum block size of an
+ * allocator that uses boundary tags like mm.c.
+ *
+ *	unix> mmprof traces/realloc-bal.rep
+ *	unix> mmprof -e app.rep > app.hist; mmgen -d emp:app.hist -o syn.rep
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "config.h"
+#include "trace.h"
+
+/* Misc */
+#define NBUCKETS      33  /* power-of-two buckets: [0,2), [2,4), ..., [2^32,) */
+#define DEF_POINTS    20  /* default number of rows in the live-bytes curve */
+#define DEF_OVERHEAD   8  /* default per-block overhead (header and footer) */
+#define DEF_MINBLOCK  16  /* default minimum block size */
+
+/* Round up to the driver's alignment */
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+
+/* Per-id state of the trace */
+typedef struct {
+    long long birth;   /* request number of the alloc */
+    int size;          /* current payload size */
+    int chain;         /* reallocs since the alloc */
+    char live;         /* nonzero between alloc and free */
+} idinfo_t;
+
+/* An exact request size and how often it was allocated (for -e) */
+typedef struct {
+    unsigned size;
+    long long count;
+} sizecount_t;
+
+/* Global variables */
+static int points = DEF_POINTS;      /* rows in the live-bytes curve (-p) */
+static size_t overhead = DEF_OVERHEAD; /* per-block overhead (-O) */
+static size_t minblock = DEF_MINBLOCK; /* minimum block size (-m) */
+
+static idinfo_t *ids;                /* indexed by block id */
+static int ids_cap;
+
+static sizecount_t *sizetab;         /* open-addressing hash of sizes (-e) */
+static size_t sizetab_cap, sizetab_n;
+
+/* function prototypes for internal helper routines */
+static int profile(char *path, int empirical);
+static idinfo_t *get_id(int index);
+static int bucket(long long n);
+static size_t footprint(int size);
+static sizecount_t *size_slot(unsigned size);
+static void count_size(unsigned size);
+static int cmp_size(const void *a, const void *b);
+static void print_empirical(char *path);
+static void print_hist(char *title, char *unit, long long *hist, int pct,
+		       long long other, char *other_label);
+static void usage(void);
+static void app_error(char *msg);
+static void unix_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    char c;
+    int empirical = 0;   /* print only the exact size histogram (-e) */
+    int i, rc = 0;
+
+    while ((c = getopt(argc, argv, "ep:O:m:h")) != EOF) {
+	switch (c) {
+	case 'e': /* Exact size histogram, as read by mmgen -d emp: */
+	    empirical = 1;
+	    break;
+	case 'p': /* Rows in the live-bytes curve */
+	    points = atoi(optarg);
+	    break;
+	case 'O': /* Per-block overhead for the util bound */
+	    overhead = atoi(optarg);
+	    break;
+	case 'm': /* Minimum block size for the util bound */
+	    minblock = atoi(optarg);
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (optind == argc || points < 1) {
+	usage();
+	exit(1);
+    }
+
+    for (i = optind; i < argc; i++)
+	if (profile(argv[i], empirical) < 0)
+	    rc = 1;
+    exit(rc);
+}
+
+/*
+ * profile - Read one trace and print its profile. Returns 0 on
+ *     success and -1 if the trace is malformed.
+ */
+static int profile(char *path, int empirical)
+{
+    tracefile_t *tf;
+    traceop_t op;
+    idinfo_t *id;
+    int rc, b, oldsize;
+    long long now = 0;            /* requests read so far */
+    long long interval, next_row; /* live-bytes curve sampling */
+    long long nallocs = 0, nreallocs = 0, nfrees = 0;
+    long long size_hist[NBUCKETS], life_hist[NBUCKETS], chain_hist[NBUCKETS];
+    long long live_per_bucket[NBUCKETS], peak_per_bucket[NBUCKETS];
+    long long live_blocks = 0, peak_blocks = 0, never_freed = 0, no_realloc = 0;
+    size_t live_bytes = 0, peak_bytes = 0, row_peak = 0;
+    size_t live_aligned = 0, peak_aligned = 0;
+    size_t live_foot = 0, peak_foot = 0;
+    size_t total_bytes = 0;
+
+    if ((tf = trace_open(path)) == NULL) {
+	fprintf(stderr, "Could not open trace %s: %s\n", path, strerror(errno));
+	return -1;
+    }
+    memset(size_hist, 0, sizeof(size_hist));
+    memset(life_hist, 0, sizeof(life_hist));
+    memset(chain_hist, 0, sizeof(chain_hist));
+    memset(live_per_bucket, 0, sizeof(live_per_bucket));
+    memset(peak_per_bucket, 0, sizeof(peak_per_bucket));
+    sizetab_n = 0;
+    if (sizetab != NULL)
+	memset(sizetab, 0, sizetab_cap * sizeof(sizecount_t));
+    if (tf->num_ids > ids_cap)
+	get_id(tf->num_ids - 1);
+    memset(ids, 0, ids_cap * sizeof(idinfo_t));
+
+    interval = (tf->num_ops + points - 1) / points;
+    interval = (interval < 1) ? 1 : interval;
+    next_row = interval;
+    if (!empirical) {
+	printf("Trace %s: %d ops, %d ids\n\n", path, tf->num_ops, tf->num_ids);
+	printf("Live blocks and bytes over time\n");
+	printf("%12s %12s %14s %14s\n", "ops", "blocks", "bytes", "peak bytes");
+    }
+
+    while ((rc = trace_next(tf, &op)) == 1) {
+	id = get_id(op.index);
+	switch (op.type) {
+	case ALLOC:
+	case MEMALIGN:
+	case CALLOC:
+	    if (id->live) {
+		fprintf(stderr, "%s: id %d allocated twice\n", path, op.index);
+		rc = -1;
+		break;
+	    }
+	    nallocs++;
+	    if (empirical)
+		count_size(op.size);
+	    size_hist[bucket(op.size)]++;
+	    b = bucket(op.size);
+	    if (++live_per_bucket[b] > peak_per_bucket[b])
+		peak_per_bucket[b] = live_per_bucket[b];
+	    id->birth = now;
+	    id->size = op.size;
+	    id->chain = 0;
+	    id->live = 1;
+	    live_blocks++;
+	    live_bytes += op.size;
+	    live_aligned += ALIGN(op.size);
+	    live_foot += footprint(op.size);
+	    total_bytes += op.size;
+	    break;
+	case REALLOC:
+	    if (!id->live) {
+		fprintf(stderr, "%s: realloc of free id %d\n", path, op.index);
+		rc = -1;
+		break;
+	    }
+	    nreallocs++;
+	    oldsize = id->size;
+	    live_per_bucket[bucket(oldsize)]--;
+	    b = bucket(op.size);
+	    if (++live_per_bucket[b] > peak_per_bucket[b])
+		peak_per_bucket[b] = live_per_bucket[b];
+	    live_bytes += op.size - (size_t)oldsize;
+	    live_aligned += ALIGN(op.size) - ALIGN(oldsize);
+	    live_foot += footprint(op.size) - footprint(oldsize);
+	    id->size = op.size;
+	    id->chain++;
+	    break;
+	case FREE:
+	    if (!id->live) {
+		fprintf(stderr, "%s: free of free id %d\n", path, op.index);
+		rc = -1;
+		break;
+	    }
+	    nfrees++;
+	    live_per_bucket[bucket(id->size)]--;
+	    life_hist[bucket(now - id->birth)]++;
+	    if (id->chain > 0)
+		chain_hist[bucket(id->chain)]++;
+	    else
+		no_realloc++;
+	    id->live = 0;
+	    live_blocks--;
+	    live_bytes -= id->size;
+	    live_aligned -= ALIGN(id->size);
+	    live_foot -= footprint(id->size);
+	    break;
+	}
+	if (rc < 0)
+	    break;
+
+	now++;
+	peak_blocks = (live_blocks > peak_blocks) ? live_blocks : peak_blocks;
+	peak_bytes = (live_bytes > peak_bytes) ? live_bytes : peak_bytes;
+	peak_aligned = (live_aligned > peak_aligned) ? live_aligned : peak_aligned;
+	peak_foot = (live_foot > peak_foot) ? live_foot : peak_foot;
+	row_peak = (live_bytes > row_peak) ? live_bytes : row_peak;
+	if (now == next_row && !empirical) {
+	    printf("%12lld %12lld %14lu %14lu\n", now, live_blocks,
+		   (unsigned long)live_bytes, (unsigned long)row_peak);
+	    next_row += interval;
+	    row_peak = 0;
+	}
+    }
+    trace_close(tf);
+    if (rc < 0)
+	return -1;
+
+    if (empirical) {
+	print_empirical(path);
+	return 0;
+    }
+    if (now != next_row - interval)
+	printf("%12lld %12lld %14lu %14lu\n", now, live_blocks,
+	       (unsigned long)live_bytes, (unsigned long)row_peak);
+
+    /* Blocks still live at the end never got a lifetime or chain length */
+    for (b = 0; b < ids_cap; b++) {
+	if (ids[b].live) {
+	    never_freed++;
+	    if (ids[b].chain > 0)
+		chain_hist[bucket(ids[b].chain)]++;
+	    else
+		no_realloc++;
+	}
+    }
+
+    printf("\n%lld allocs, %lld reallocs, %lld frees, mean alloc size %.1f bytes\n",
+	   nallocs, nreallocs, nfrees,
+	   nallocs ? (double)total_bytes / nallocs : 0.0);
+    print_hist("Alloc request sizes", "bytes", size_hist, 1, 0, NULL);
+    print_hist("Block lifetimes", "ops", life_hist, 1, never_freed,
+	       "never freed");
+    print_hist("Realloc chain lengths", "reallocs", chain_hist, 1, no_realloc,
+	       "none");
+    print_hist("Peak concurrent blocks per size", "bytes", peak_per_bucket, 0,
+	       peak_blocks, "all sizes");
+
+    printf("\nPeak live payload  %14lu bytes\n", (unsigned long)peak_bytes);
+    printf("Peak aligned       %14lu bytes   util bound %5.1f%%\n",
+	   (unsigned long)peak_aligned,
+	   peak_aligned ? 100.0 * peak_bytes / peak_aligned : 100.0);
+    printf("Peak with overhead %14lu bytes   util bound %5.1f%%"
+	   "   (%lu bytes/block, min %lu)\n\n",
+	   (unsigned long)peak_foot,
+	   peak_foot ? 100.0 * peak_bytes / peak_foot : 100.0,
+	   (unsigned long)overhead, (unsigned long)minblock);
+    return 0;
+}
+
+/*
+ * get_id - Return the state of block id index, growing the table
+ *     if the trace uses more ids than its header announced
+ */
+static idinfo_t *get_id(int index)
+{
+    int newcap;
+
+    if (index < 0)
+	app_error("negative block id in trace");
+    if (index >= ids_cap) {
+	for (newcap = ids_cap ? ids_cap : 1024; newcap <= index; newcap *= 2)
+	    ;
+	if ((ids = realloc(ids, newcap * sizeof(idinfo_t))) == NULL)
+	    unix_error("realloc failed in get_id");
+	memset(ids + ids_cap, 0, (newcap - ids_cap) * sizeof(idinfo_t));
+	ids_cap = newcap;
+    }
+    return &ids[index];
+}
+
+/*
+ * bucket - Return the power-of-two bucket of n: 0 for n < 2, else
+ *     floor(log2(n)), capped at NBUCKETS-1
+ */
+static int bucket(long long n)
+{
+    int b = 0;
+
+    while (n >= 2 && b < NBUCKETS - 1) {
+	n >>= 1;
+	b++;
+    }
+    return b;
+}
+
+/*
+ * footprint - Heap bytes taken by a block with a size-byte payload
+ *     in an allocator with boundary tags, like mm.c
+ */
+static size_t footprint(int size)
+{
+    size_t asize = ALIGN(size + overhead);
+
+    return (asize > minblock) ? asize : minblock;
+}
+
+/*
+ * size_slot - Return the slot of size in the size hash table,
+ *     claiming an empty one if size is not there yet
+ */
+static sizecount_t *size_slot(unsigned size)
+{
+    size_t i;
+
+    for (i = (size * 2654435761u) & (sizetab_cap - 1);
+	 sizetab[i].count > 0 && sizetab[i].size != size;
+	 i = (i + 1) & (sizetab_cap - 1))
+	;
+    sizetab[i].size = size;
+    return &sizetab[i];
+}
+
+/*
+ * count_size - Count one alloc request of exactly size bytes, doubling
+ *     the hash table when it becomes half full
+ */
+static void count_size(unsigned size)
+{
+    sizecount_t *old = sizetab, *slot;
+    size_t i, oldcap = sizetab_cap;
+
+    if (2 * (sizetab_n + 1) > sizetab_cap) {
+	sizetab_cap = sizetab_cap ? 2 * sizetab_cap : 1024;
+	if ((sizetab = calloc(sizetab_cap, sizeof(sizecount_t))) == NULL)
+	    unix_error("calloc failed in count_size");
+	for (i = 0; i < oldcap; i++)
+	    if (old[i].count > 0)
+		size_slot(old[i].size)->count = old[i].count;
+	free(old);
+    }
+    slot = size_slot(size);
+    if (slot->count++ == 0)
+	sizetab_n++;
+}
+
+/*
+ * cmp_size - qsort comparison of sizecount_t by size
+ */
+static int cmp_size(const void *a, const void *b)
+{
+    unsigned x = ((sizecount_t *)a)->size, y = ((sizecount_t *)b)->size;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * print_empirical - Print the "size count" histogram of alloc request
+ *     sizes, in the format read by mmgen -d emp:<file>
+ */
+static void print_empirical(char *path)
+{
+    size_t i, n = 0;
+
+    for (i = 0; i < sizetab_cap; i++)
+	if (sizetab[i].count > 0)
+	    sizetab[n++] = sizetab[i];
+    qsort(sizetab, n, sizeof(sizecount_t), cmp_size);
+    printf("# %s: %lu distinct alloc sizes\n", path, (unsigned long)n);
+    for (i = 0; i < n; i++)
+	printf("%u %lld\n", sizetab[i].size, sizetab[i].count);
+    memset(sizetab, 0, sizetab_cap * sizeof(sizecount_t));
+    sizetab_n = 0;
+}
+
+/*
+ * print_hist - Print the nonempty buckets of a power-of-two histogram,
+ *     followed by an extra row if other_label is given. With pct, the
+ *     rows are also shown as a percentage of their total.
+ */
+static void print_hist(char *title, char *unit, long long *hist, int pct,
+		       long long other, char *other_label)
+{
+    int b;
+    long long total = other;
+
+    for (b = 0; b < NBUCKETS; b++)
+	total += hist[b];
+    total = (pct && total > 0) ? total : 0;
+    printf("\n%s\n", title);
+    if (total)
+	printf("%24s %14s %7s\n", unit, "count", "pct");
+    else
+	printf("%24s %14s\n", unit, "count");
+    for (b = 0; b < NBUCKETS; b++) {
+	if (hist[b] == 0)
+	    continue;
+	if (b == 0)
+	    printf("%11s %12s", "0 -", "1");
+	else if (b == NBUCKETS - 1)
+	    printf("%11llu %12s", 1ULL << b, "-");
+	else
+	    printf("%11llu - %10llu", 1ULL << b, (1ULL << (b + 1)) - 1);
+	printf(" %14lld", hist[b]);
+	if (total)
+	    printf(" %6.1f%%", 100.0 * hist[b] / total);
+	printf("\n");
+    }
+    if (other_label != NULL) {
+	printf("%24s %14lld", other_label, other);
+	if (total)
+	    printf(" %6.1f%%", 100.0 * other / total);
+	printf("\n");
+    }
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmprof [-he] [-p <rows>] [-O <bytes>] [-m <bytes>] <trace>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-e         Print only the exact alloc size histogram, for mmgen.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-m <bytes> Minimum block size for the util bound (default %d).\n",
+	    DEF_MINBLOCK);
+    fprintf(stderr, "\t-O <bytes> Per-block overhead for the util bound (default %d).\n",
+	    DEF_OVERHEAD);
+    fprintf(stderr, "\t-p <rows>  Rows in the live-bytes curve (default %d).\n",
+	    DEF_POINTS);
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
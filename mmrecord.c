@@ -0,0 +1,690 @@
+/*
+ * mmrecord.c - LD_PRELOAD recorder that captures the allocation
+ *              requests of a running program as a malloc lab trace.
+ *
+ * Build the shared library with "make libmmrecord.so" and run
+ *
+ *	unix> LD_PRELOAD=./libmmrecord.so MMRECORD_FILE=app.rep app args...
+ *	unix> mdriver -f app.rep
+ *
+ * Environment variables:
+ *	MMRECORD_FILE     output trace, "%p" is replaced by the process id
+ *	                  (default "mmrecord.%p.rep")
+ *	MMRECORD_BINARY   if set to 1, write the binary trace format
+ *	MMRECORD_BALANCE  if set to 1, free every block still live at exit,
+ *	                  like the *-bal.rep traces
+ *
+ * Calls are forwarded to the next malloc in the link chain (normally
+ * libc's). On the way, each request is appended to a buffer owned by
+ * the calling thread, stamped with a sequence number from one global
+ * atomic counter, so recording takes no locks. Full buffers are written
+ * to a spool file next to the output with a single write(2).
+ *
+ * Trace ids are assigned when the process exits: the spooled events are
+ * sorted by sequence number and replayed, and every live pointer gets
+ * the lowest id not currently in use. Ids are thus reused, which keeps
+ * num_ids near the peak number of live blocks. Frees of pointers the
+ * recorder never saw allocated are dropped. Requests of 0 bytes are
+ * recorded as 1 byte, since the driver requires a nonzero size.
+ * Aligned allocations are recorded as memalign requests ('m') with
+ * their alignment, and calloc as calloc requests ('c').
+ *
+ * A program that leaves with _exit(2) or a fatal signal loses the
+ * events still buffered, and no trace is written for it.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+/* Misc */
+#define MAXLINE     1024          /* max string size */
+#define BUF_EVENTS  16384         /* events per thread buffer */
+#define BOOT_SIZE   (16*1024)     /* arena for calls made by dlsym */
+#define DEFAULT_FILE "mmrecord.%p.rep"
+
+/* Event types */
+#define EV_ALLOC    1  /* ptr was returned by malloc and friends */
+#define EV_FREE     2  /* ptr is about to be freed */
+#define EV_RELEASE  3  /* ptr is about to be handed to realloc */
+#define EV_REALLOC  4  /* realloc of ptr returned newptr (0 on failure) */
+#define EV_MEMALIGN 5  /* ptr was returned aligned to newptr bytes */
+#define EV_CALLOC   6  /* ptr was returned zeroed by calloc */
+
+/* One recorded request */
+typedef struct {
+    uint64_t seq;      /* global order of the request */
+    uintptr_t ptr;     /* block allocated, freed or reallocated */
+    uintptr_t newptr;  /* block returned by realloc */
+    uint32_t size;     /* requested bytes */
+    uint32_t type;     /* EV_xxx */
+} event_t;
+
+/* A per-thread event buffer, never freed and reused by later threads */
+typedef struct recbuf_t {
+    struct recbuf_t *next; /* list of all buffers, for the flush at exit */
+    volatile int busy;     /* owned by a live thread */
+    size_t n;              /* events in ev[] */
+    event_t ev[BUF_EVENTS];
+} recbuf_t;
+
+/* Maps live pointers to trace ids while the events are converted */
+typedef struct {
+    uintptr_t *keys;   /* 0 marks an empty slot */
+    int *ids;
+    size_t cap;        /* power of two */
+    size_t count;
+} ptrmap_t;
+
+/* The next allocator in the link chain */
+static void *(*real_malloc)(size_t);
+static void (*real_free)(void *);
+static void *(*real_realloc)(void *, size_t);
+static void *(*real_calloc)(size_t, size_t);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+static void *(*real_valloc)(size_t);
+static void *(*real_pvalloc)(size_t);
+
+/* Global variables */
+static volatile int rec_state;     /* 0 = not started, 1 = starting, 2 = on */
+static int resolving;              /* inside dlsym */
+static uint64_t rec_seq;           /* next sequence number */
+static recbuf_t *volatile rec_bufs; /* all thread buffers */
+static pthread_key_t rec_key;      /* releases a buffer at thread exit */
+static int spool_fd = -1;
+static char out_path[MAXLINE];
+static char spool_path[MAXLINE + 8];
+
+static __thread recbuf_t *my_buf
+    __attribute__((tls_model("initial-exec")));
+static __thread int in_rec         /* recorder itself is running */
+    __attribute__((tls_model("initial-exec")));
+
+static char boot_heap[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used;
+
+/* Returns true if p was handed out while resolving the real functions */
+#define IN_BOOT(p)  ((char *)(p) >= boot_heap && \
+		     (char *)(p) < boot_heap + BOOT_SIZE)
+
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Returns true if requests from this thread should be recorded */
+#define RECORDING() (rec_state == 2 && !in_rec)
+
+/* function prototypes for internal helper routines */
+static void rec_init(void);
+static void rec_finish(void) __attribute__((destructor));
+static void record(uint32_t type, void *ptr, void *newptr, size_t size);
+static recbuf_t *get_buf(void);
+static void put_buf(void *arg);
+static void flush_buf(recbuf_t *b);
+static void fork_child(void);
+static void convert(void);
+static int cmp_seq(const void *a, const void *b);
+static int map_get(ptrmap_t *m, uintptr_t key);
+static int map_put(ptrmap_t *m, uintptr_t key, int id);
+static void map_del(ptrmap_t *m, uintptr_t key);
+static void *boot_alloc(size_t size);
+static void make_path(char *dst, const char *pattern);
+
+/*
+ * The interposed allocator interface
+ */
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL) {
+	rec_init();
+	if (real_malloc == NULL)
+	    return boot_alloc(size);
+    }
+    p = real_malloc(size);
+    if (p != NULL && RECORDING())
+	record(EV_ALLOC, p, NULL, size);
+    return p;
+}
+
+void free(void *p)
+{
+    if (p == NULL || IN_BOOT(p))
+	return;
+    if (real_free == NULL)
+	rec_init();
+    if (RECORDING())
+	record(EV_FREE, p, NULL, 0);
+    real_free(p);
+}
+
+void *realloc(void *oldp, size_t size)
+{
+    void *newp;
+
+    if (oldp == NULL)
+	return malloc(size);
+    if (IN_BOOT(oldp)) {
+	if ((newp = malloc(size)) != NULL)
+	    memcpy(newp, oldp, MIN(size, (size_t)(boot_heap + BOOT_SIZE -
+						  (char *)oldp)));
+	return newp;
+    }
+    if (!RECORDING())
+	return real_realloc(oldp, size);
+    if (size == 0) {
+	record(EV_FREE, oldp, NULL, 0);
+	return real_realloc(oldp, size);
+    }
+
+    record(EV_RELEASE, oldp, NULL, 0);
+    newp = real_realloc(oldp, size);
+    record(EV_REALLOC, oldp, newp, size);
+    return newp;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (real_calloc == NULL) {
+	rec_init();
+	if (real_calloc == NULL)
+	    return boot_alloc(nmemb * size); /* boot_heap is zero */
+    }
+    p = real_calloc(nmemb, size);
+    if (p != NULL && RECORDING())
+	record(EV_CALLOC, p, NULL, nmemb * size);
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    int rc;
+
+    if (real_posix_memalign == NULL)
+	rec_init();
+    rc = real_posix_memalign(memptr, align, size);
+    if (rc == 0 && RECORDING())
+	record(EV_MEMALIGN, *memptr, (void *)align, size);
+    return rc;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_aligned_alloc == NULL)
+	rec_init();
+    p = real_aligned_alloc(align, size);
+    if (p != NULL && RECORDING())
+	record(EV_MEMALIGN, p, (void *)align, size);
+    return p;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_memalign == NULL)
+	rec_init();
+    p = real_memalign(align, size);
+    if (p != NULL && RECORDING())
+	record(EV_MEMALIGN, p, (void *)align, size);
+    return p;
+}
+
+void *valloc(size_t size)
+{
+    void *p;
+
+    if (real_valloc == NULL)
+	rec_init();
+    p = real_valloc(size);
+    if (p != NULL && RECORDING())
+	record(EV_MEMALIGN, p, (void *)sysconf(_SC_PAGESIZE), size);
+    return p;
+}
+
+void *pvalloc(size_t size)
+{
+    void *p;
+
+    if (real_pvalloc == NULL)
+	rec_init();
+    p = real_pvalloc(size);
+    if (p != NULL && RECORDING())
+	record(EV_MEMALIGN, p, (void *)sysconf(_SC_PAGESIZE), size);
+    return p;
+}
+
+/* The remaining routines are internal helper routines */
+
+/*
+ * rec_init - Resolve the real allocator and open the spool file. Runs
+ *     from the constructor or from the first allocation, whichever
+ *     comes first; a nested call made by dlsym returns at once.
+ */
+__attribute__((constructor))
+static void rec_init(void)
+{
+    char *env;
+
+    if (resolving || !__sync_bool_compare_and_swap(&rec_state, 0, 1)) {
+	while (rec_state == 1 && !resolving)
+	    ; /* another thread is starting the recorder */
+	return;
+    }
+
+    resolving = 1;
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_valloc = dlsym(RTLD_NEXT, "valloc");
+    real_pvalloc = dlsym(RTLD_NEXT, "pvalloc");
+    resolving = 0;
+
+    in_rec = 1;
+    make_path(out_path, (env = getenv("MMRECORD_FILE")) ? env : DEFAULT_FILE);
+    snprintf(spool_path, sizeof(spool_path), "%s.spool", out_path);
+    spool_fd = open(spool_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (spool_fd < 0 || pthread_key_create(&rec_key, put_buf) != 0) {
+	fprintf(stderr, "mmrecord: cannot open %s: %s\n",
+		spool_path, strerror(errno));
+	in_rec = 0;
+	rec_state = 3; /* forward calls without recording */
+	return;
+    }
+    pthread_atfork(NULL, NULL, fork_child);
+    in_rec = 0;
+    rec_state = 2;
+}
+
+/*
+ * record - Append one event to the calling thread's buffer
+ */
+static void record(uint32_t type, void *ptr, void *newptr, size_t size)
+{
+    recbuf_t *b;
+    event_t *e;
+
+    if ((b = my_buf) == NULL && (b = get_buf()) == NULL)
+	return;
+    if (b->n == BUF_EVENTS)
+	flush_buf(b);
+
+    e = &b->ev[b->n];
+    e->seq = __sync_fetch_and_add(&rec_seq, 1);
+    e->type = type;
+    e->ptr = (uintptr_t)ptr;
+    e->newptr = (uintptr_t)newptr;
+    e->size = (size == 0) ? 1 : (size > INT_MAX) ? INT_MAX : size;
+    b->n++;
+}
+
+/*
+ * get_buf - Give the calling thread a buffer, reusing one released by
+ *     an exited thread if possible
+ */
+static recbuf_t *get_buf(void)
+{
+    recbuf_t *b;
+
+    in_rec = 1;
+    for (b = rec_bufs; b != NULL; b = b->next)
+	if (!b->busy && __sync_bool_compare_and_swap(&b->busy, 0, 1))
+	    break;
+
+    if (b == NULL) {
+	b = mmap(NULL, sizeof(recbuf_t), PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (b == MAP_FAILED) {
+	    in_rec = 0;
+	    return NULL;
+	}
+	b->busy = 1;
+	do
+	    b->next = rec_bufs;
+	while (!__sync_bool_compare_and_swap(&rec_bufs, b->next, b));
+    }
+
+    pthread_setspecific(rec_key, b);
+    my_buf = b;
+    in_rec = 0;
+    return b;
+}
+
+/*
+ * put_buf - Thread exit handler: spool the thread's events and make its
+ *     buffer available to new threads
+ */
+static void put_buf(void *arg)
+{
+    recbuf_t *b = (recbuf_t *)arg;
+
+    flush_buf(b);
+    my_buf = NULL;
+    __sync_synchronize();
+    b->busy = 0;
+}
+
+/*
+ * flush_buf - Append the events in b to the spool file
+ */
+static void flush_buf(recbuf_t *b)
+{
+    char *p = (char *)b->ev;
+    size_t left = b->n * sizeof(event_t);
+    ssize_t n;
+
+    while (left > 0) {
+	if ((n = write(spool_fd, p, left)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	p += n;
+	left -= n;
+    }
+    b->n = 0;
+}
+
+/*
+ * fork_child - The child records into its own files. Events buffered
+ *     before the fork belong to the parent and are discarded.
+ */
+static void fork_child(void)
+{
+    recbuf_t *b;
+    char *env;
+
+    for (b = rec_bufs; b != NULL; b = b->next) {
+	b->n = 0;
+	if (b != my_buf)
+	    b->busy = 0;
+    }
+    close(spool_fd);
+    make_path(out_path, (env = getenv("MMRECORD_FILE")) ? env : DEFAULT_FILE);
+    snprintf(spool_path, sizeof(spool_path), "%s.spool", out_path);
+    spool_fd = open(spool_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (spool_fd < 0)
+	rec_state = 3;
+}
+
+/*
+ * rec_finish - At exit, spool every buffer and convert the events into
+ *     the trace file
+ */
+static void rec_finish(void)
+{
+    recbuf_t *b;
+
+    if (rec_state != 2)
+	return;
+    in_rec = 1;
+    rec_state = 3;
+    for (b = rec_bufs; b != NULL; b = b->next)
+	flush_buf(b);
+    convert();
+    close(spool_fd);
+    unlink(spool_path);
+}
+
+/*
+ * convert - Replay the spooled events in sequence order, assigning
+ *     trace ids, and write the trace
+ */
+static void convert(void)
+{
+    struct stat st;
+    event_t *ev;
+    size_t nev, i;
+    ptrmap_t live = {0}, pending = {0};
+    int *free_ids = NULL, nfree = 0, free_cap = 0, next_id = 0, id;
+    tracefile_t *tf;
+    traceop_t op = {0};
+    char *env;
+
+    if (fstat(spool_fd, &st) < 0)
+	return;
+    nev = st.st_size / sizeof(event_t);
+    ev = (nev == 0) ? NULL : mmap(NULL, nev * sizeof(event_t),
+				  PROT_READ | PROT_WRITE, MAP_PRIVATE,
+				  spool_fd, 0);
+    if (ev == MAP_FAILED) {
+	fprintf(stderr, "mmrecord: cannot map %s\n", spool_path);
+	return;
+    }
+    qsort(ev, nev, sizeof(event_t), cmp_seq);
+
+    env = getenv("MMRECORD_BINARY");
+    if ((tf = trace_create(out_path, env != NULL && atoi(env))) == NULL) {
+	fprintf(stderr, "mmrecord: cannot create %s: %s\n",
+		out_path, strerror(errno));
+	goto out;
+    }
+    tf->sugg_heapsize = 0;
+
+    for (i = 0; i < nev; i++) {
+	switch (ev[i].type) {
+	case EV_ALLOC:
+	case EV_MEMALIGN:
+	case EV_CALLOC:
+	    id = nfree ? free_ids[--nfree] : next_id++;
+	    map_put(&live, ev[i].ptr, id);
+	    op.type = (ev[i].type == EV_ALLOC) ? ALLOC :
+		(ev[i].type == EV_MEMALIGN) ? MEMALIGN : CALLOC;
+	    op.align = ev[i].newptr;
+	    break;
+
+	case EV_FREE:
+	    if ((id = map_get(&live, ev[i].ptr)) < 0)
+		continue; /* not allocated while we were watching */
+	    map_del(&live, ev[i].ptr);
+	    if (nfree == free_cap) {
+		free_cap = free_cap ? 2 * free_cap : 1024;
+		free_ids = real_realloc(free_ids, free_cap * sizeof(int));
+	    }
+	    free_ids[nfree++] = id;
+	    op.type = FREE;
+	    break;
+
+	case EV_RELEASE:
+	    if ((id = map_get(&live, ev[i].ptr)) >= 0) {
+		map_del(&live, ev[i].ptr);
+		map_put(&pending, ev[i].ptr, id);
+	    }
+	    continue;
+
+	case EV_REALLOC:
+	    id = map_get(&pending, ev[i].ptr);
+	    if (id >= 0)
+		map_del(&pending, ev[i].ptr);
+	    if (ev[i].newptr == 0) { /* failed, the old block survives */
+		if (id >= 0)
+		    map_put(&live, ev[i].ptr, id);
+		continue;
+	    }
+	    if (id < 0) { /* unknown old block, so this is its first sight */
+		id = nfree ? free_ids[--nfree] : next_id++;
+		op.type = ALLOC;
+	    }
+	    else
+		op.type = REALLOC;
+	    map_put(&live, ev[i].newptr, id);
+	    break;
+
+	default:
+	    continue;
+	}
+	op.index = id;
+	op.size = ev[i].size;
+	trace_put(tf, &op);
+    }
+
+    /* Optionally free whatever is still live */
+    env = getenv("MMRECORD_BALANCE");
+    if (env != NULL && atoi(env)) {
+	for (i = 0; i < live.cap; i++) {
+	    if (live.keys[i] != 0) {
+		op.type = FREE;
+		op.index = live.ids[i];
+		op.size = 0;
+		trace_put(tf, &op);
+	    }
+	}
+    }
+
+    if (trace_close(tf) < 0)
+	fprintf(stderr, "mmrecord: error writing %s\n", out_path);
+
+ out:
+    if (ev != NULL)
+	munmap(ev, nev * sizeof(event_t));
+    real_free(live.keys);
+    real_free(live.ids);
+    real_free(pending.keys);
+    real_free(pending.ids);
+    real_free(free_ids);
+}
+
+/*
+ * cmp_seq - qsort comparison of two events by sequence number
+ */
+static int cmp_seq(const void *a, const void *b)
+{
+    uint64_t x = ((const event_t *)a)->seq, y = ((const event_t *)b)->seq;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * The ptrmap_t routines implement a linear probing hash table
+ */
+
+#define HASH(key, cap)  ((((key) >> 4) * 0x9E3779B97F4A7C15ULL) & ((cap) - 1))
+
+/*
+ * map_get - Return the id stored for key, or -1 if there is none
+ */
+static int map_get(ptrmap_t *m, uintptr_t key)
+{
+    size_t i;
+
+    if (m->cap == 0)
+	return -1;
+    for (i = HASH(key, m->cap); m->keys[i] != 0; i = (i + 1) & (m->cap - 1))
+	if (m->keys[i] == key)
+	    return m->ids[i];
+    return -1;
+}
+
+/*
+ * map_put - Store id for key, growing the table when half full.
+ *     Returns -1 if out of memory.
+ */
+static int map_put(ptrmap_t *m, uintptr_t key, int id)
+{
+    ptrmap_t big;
+    size_t i;
+
+    if (2 * (m->count + 1) > m->cap) {
+	big.cap = m->cap ? 2 * m->cap : 1024;
+	big.count = 0;
+	big.keys = real_calloc(big.cap, sizeof(uintptr_t));
+	big.ids = real_malloc(big.cap * sizeof(int));
+	if (big.keys == NULL || big.ids == NULL)
+	    return -1;
+	for (i = 0; i < m->cap; i++)
+	    if (m->keys[i] != 0)
+		map_put(&big, m->keys[i], m->ids[i]);
+	real_free(m->keys);
+	real_free(m->ids);
+	*m = big;
+    }
+
+    for (i = HASH(key, m->cap); m->keys[i] != 0; i = (i + 1) & (m->cap - 1))
+	if (m->keys[i] == key)
+	    break;
+    if (m->keys[i] == 0)
+	m->count++;
+    m->keys[i] = key;
+    m->ids[i] = id;
+    return 0;
+}
+
+/*
+ * map_del - Remove key, shifting later entries of its probe run back
+ */
+static void map_del(ptrmap_t *m, uintptr_t key)
+{
+    size_t i, j, h;
+
+    if (m->cap == 0)
+	return;
+    for (i = HASH(key, m->cap); m->keys[i] != key; i = (i + 1) & (m->cap - 1))
+	if (m->keys[i] == 0)
+	    return;
+
+    m->keys[i] = 0;
+    m->count--;
+    for (j = (i + 1) & (m->cap - 1); m->keys[j] != 0; j = (j + 1) & (m->cap - 1)) {
+	h = HASH(m->keys[j], m->cap);
+	/* move entry j into the hole at i unless its home lies in (i, j] */
+	if ((j > i && (h <= i || h > j)) || (j < i && (h <= i && h > j))) {
+	    m->keys[i] = m->keys[j];
+	    m->ids[i] = m->ids[j];
+	    m->keys[j] = 0;
+	    i = j;
+	}
+    }
+}
+
+/*
+ * boot_alloc - Serve the allocations dlsym makes before the real
+ *     allocator is known. This memory is never reused.
+ */
+static void *boot_alloc(size_t size)
+{
+    size_t asize = (size + 15) & ~(size_t)15, old;
+
+    old = __sync_fetch_and_add(&boot_used, asize);
+    if (old + asize > BOOT_SIZE)
+	return NULL;
+    return boot_heap + old;
+}
+
+/*
+ * make_path - Copy pattern to dst, replacing each "%p" by our pid
+ */
+static void make_path(char *dst, const char *pattern)
+{
+    size_t n = 0;
+
+    for (; *pattern != '\0' && n < MAXLINE - 24; pattern++) {
+	if (pattern[0] == '%' && pattern[1] == 'p') {
+	    n += sprintf(dst + n, "%d", (int)getpid());
+	    pattern++;
+	}
+	else
+	    dst[n++] = *pattern;
+    }
+    dst[n] = '\0';
+}
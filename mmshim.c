@@ -0,0 +1,403 @@
+/*
+ * mmshim.c - LD_PRELOAD shim that makes the mm.c package the real
+ *            allocator of an arbitrary Linux program.
+ *
+ * Build the shared library with "make libmm.so" and run a program as
+ *
+ *	unix> LD_PRELOAD=./libmm.so some-program args...
+ *
+ * The shim exports malloc, free, free_sized, free_aligned_sized, realloc,
+ * calloc, posix_memalign, aligned_alloc, memalign, valloc, pvalloc and
+ * malloc_usable_size.
+ * Every call is serialized by a single mutex, since mm.c keeps its
+ * state in unsynchronized globals.
+ *
+ * memlib's simulated break is backed by one large anonymous mapping
+ * reserved up front and committed as the break grows. Its size
+ * is taken from the MM_HEAP_MAX environment variable (in bytes),
+ * defaulting to DEFAULT_HEAP_MAX. Requests of at least MM_MMAP_THRESHOLD
+ * bytes, if set, get their own mapping instead (see mm_setopt).
+ *
+ * Idle free memory is purged every MM_PURGE_DECAY requests (see
+ * mm_setopt). A program that goes quiet makes no requests, so if
+ * MM_PURGE_MS is set a background thread also calls mm_purge under
+ * the lock every that many milliseconds.
+ *
+ * Two situations would otherwise recurse into the allocator while it
+ * is already running on the same thread: the very first call, when
+ * pthread_atfork and friends may themselves call malloc, and libc
+ * routines used by memlib to report errors. Such nested calls are
+ * served from a small static bootstrap arena that is never reused.
+ *
+ * Fork safety: the mutex is taken in the pthread_atfork prepare
+ * handler and released in both parent and child, so a child never
+ * inherits a heap that another thread was halfway through changing.
+ *
+ * Alignments above ALIGNMENT come from mm_memalign, whose blocks are
+ * ordinary blocks to free, realloc and malloc_usable_size.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+/* Default size of the reserved heap mapping (bytes) */
+#define DEFAULT_HEAP_MAX  ((size_t)1 << 30)  /* 1 GB */
+
+/* Size of the bootstrap arena used for reentrant calls (bytes) */
+#define BOOT_SIZE    (64*1024)
+#define BOOT_HDR     16      /* per-block size prefix, keeps 16B alignment */
+
+/* Returns true if p lies in the bootstrap arena */
+#define IN_BOOT(p)  ((char *)(p) >= boot_heap && \
+		     (char *)(p) < boot_heap + BOOT_SIZE)
+
+/* Returns true if x is a nonzero power of two */
+#define IS_POW2(x)  ((x) != 0 && ((x) & ((x) - 1)) == 0)
+
+/* Global variables */
+static pthread_mutex_t shim_lock = PTHREAD_MUTEX_INITIALIZER;
+static int shim_ready;            /* mem_init and mm_init are done */
+static size_t heap_max;           /* size of the reserved heap mapping */
+static long purge_ms;             /* period of the purge thread, 0 = none */
+static __thread int in_shim       /* set while this thread is inside mm */
+    __attribute__((tls_model("initial-exec")));
+
+static char boot_heap[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used;          /* bump pointer into boot_heap */
+
+/* function prototypes for internal helper routines */
+static int shim_enter(void);
+static void shim_leave(void);
+static void shim_init(void);
+static void purge_start(void);
+static void *purge_thread(void *arg);
+static void *boot_alloc(size_t size);
+static size_t boot_size(void *p);
+static void free_locked(void *p);
+static void free_sized_locked(void *p, size_t size);
+static size_t usable_size_locked(void *p);
+
+/*
+ * The exported allocator interface
+ */
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (!shim_enter())
+	return boot_alloc(size);
+    p = (size < heap_max) ? mm_malloc(size ? size : 1) : NULL;
+    shim_leave();
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+void free(void *p)
+{
+    if (p == NULL)
+	return;
+    if (!shim_enter())
+	return; /* only bootstrap blocks can be freed reentrantly */
+    free_locked(p);
+    shim_leave();
+}
+
+void free_sized(void *p, size_t size)
+{
+    if (p == NULL)
+	return;
+    if (!shim_enter())
+	return; /* only bootstrap blocks can be freed reentrantly */
+    free_sized_locked(p, size);
+    shim_leave();
+}
+
+void free_aligned_sized(void *p, size_t align, size_t size)
+{
+    free_sized(p, size);
+}
+
+void *realloc(void *oldp, size_t size)
+{
+    void *newp;
+    size_t oldsize;
+
+    if (oldp == NULL)
+	return malloc(size);
+    if (size == 0) {
+	free(oldp);
+	return NULL;
+    }
+
+    if (!shim_enter()) {
+	if ((newp = boot_alloc(size)) == NULL)
+	    return NULL;
+	oldsize = usable_size_locked(oldp); /* the lock is ours already */
+	memcpy(newp, oldp, oldsize < size ? oldsize : size);
+	return newp;
+    }
+
+    /* Bootstrap blocks are moved into a fresh mm block */
+    if (size >= heap_max)
+	newp = NULL;
+    else if (IN_BOOT(oldp)) {
+	oldsize = usable_size_locked(oldp);
+	if ((newp = mm_malloc(size)) != NULL) {
+	    memcpy(newp, oldp, oldsize < size ? oldsize : size);
+	    free_locked(oldp);
+	}
+    }
+    else
+	newp = mm_realloc(oldp, size);
+    shim_leave();
+    if (newp == NULL)
+	errno = ENOMEM;
+    return newp;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+    size_t bytes = nmemb * size;
+
+    if (size != 0 && bytes / size != nmemb) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if (!shim_enter())
+	return boot_alloc(bytes); /* the arena is never reused, so zero */
+    p = (bytes < heap_max) ? mm_calloc(1, bytes ? bytes : 1) : NULL;
+    shim_leave();
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (!IS_POW2(align) || align % sizeof(void *) != 0)
+	return EINVAL;
+    if (!shim_enter())
+	p = (align <= BOOT_HDR) ? boot_alloc(size) : NULL;
+    else {
+	p = (size < heap_max && align < heap_max) ?
+	    mm_memalign(align, size ? size : 1) : NULL;
+	shim_leave();
+    }
+    if (p == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    void *p;
+
+    if (!IS_POW2(align)) {
+	errno = EINVAL;
+	return NULL;
+    }
+    if (align < sizeof(void *))
+	align = sizeof(void *);
+    if ((errno = posix_memalign(&p, align, size)) != 0)
+	return NULL;
+    return p;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    return aligned_alloc(align, size);
+}
+
+void *valloc(size_t size)
+{
+    return aligned_alloc(mem_pagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t pagesize = mem_pagesize();
+
+    return aligned_alloc(pagesize, (size + pagesize - 1) & ~(pagesize - 1));
+}
+
+size_t malloc_usable_size(void *p)
+{
+    size_t size;
+
+    if (p == NULL)
+	return 0;
+    if (!shim_enter())
+	return usable_size_locked(p); /* the lock is ours already */
+    size = usable_size_locked(p);
+    shim_leave();
+    return size;
+}
+
+/* The remaining routines are internal helper routines */
+
+/*
+ * shim_enter - Take the allocator lock, initializing the heap on first
+ *     use. Returns 0 without locking if this thread is already inside
+ *     the allocator, in which case the caller must fall back to the
+ *     bootstrap arena.
+ */
+static int shim_enter(void)
+{
+    if (in_shim)
+	return 0;
+    in_shim = 1;
+    pthread_mutex_lock(&shim_lock);
+    if (!shim_ready)
+	shim_init();
+    return 1;
+}
+
+/*
+ * shim_leave - Release the allocator lock taken by shim_enter
+ */
+static void shim_leave(void)
+{
+    pthread_mutex_unlock(&shim_lock);
+    in_shim = 0;
+}
+
+static void fork_prepare(void) { pthread_mutex_lock(&shim_lock); }
+static void fork_parent(void)  { pthread_mutex_unlock(&shim_lock); }
+static void fork_child(void)   { pthread_mutex_unlock(&shim_lock); purge_start(); }
+
+/*
+ * shim_init - Reserve the heap mapping and initialize the mm package.
+ *     Called with the lock held and in_shim set, so any allocation made
+ *     by the libc routines used here goes to the bootstrap arena.
+ */
+static void shim_init(void)
+{
+    size_t maxheap = DEFAULT_HEAP_MAX;
+    char *env, *end;
+
+    if ((env = getenv("MM_HEAP_MAX")) != NULL) {
+	maxheap = strtoul(env, &end, 0);
+	if (*end != '\0' || maxheap == 0)
+	    maxheap = DEFAULT_HEAP_MAX;
+    }
+
+    if ((env = getenv("MM_MMAP_THRESHOLD")) != NULL)
+	mm_setopt(MM_OPT_MMAP_THRESHOLD, strtol(env, NULL, 0));
+    if ((env = getenv("MM_PURGE_DECAY")) != NULL)
+	mm_setopt(MM_OPT_PURGE_DECAY, strtol(env, NULL, 0));
+    if ((env = getenv("MM_PURGE_MS")) != NULL)
+	purge_ms = strtol(env, NULL, 0);
+
+    heap_max = maxheap;
+    mem_set_maxheap(maxheap);
+    mem_init();
+    if (mm_init() < 0) {
+	fprintf(stderr, "mmshim: mm_init failed\n");
+	abort();
+    }
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+    shim_ready = 1;
+    purge_start();
+}
+
+/*
+ * purge_start - Start the purge thread if MM_PURGE_MS asked for one.
+ *     Also called in a forked child, which inherits no threads.
+ */
+static void purge_start(void)
+{
+    pthread_t tid;
+
+    if (purge_ms > 0 && pthread_create(&tid, NULL, purge_thread, NULL) == 0)
+	pthread_detach(tid);
+}
+
+/*
+ * purge_thread - Call mm_purge every purge_ms milliseconds
+ */
+static void *purge_thread(void *arg)
+{
+    struct timespec ts;
+
+    ts.tv_sec = purge_ms / 1000;
+    ts.tv_nsec = (purge_ms % 1000) * 1000000;
+    for (;;) {
+	nanosleep(&ts, NULL);
+	if (shim_enter()) {
+	    mm_purge();
+	    shim_leave();
+	}
+    }
+    return arg;
+}
+
+/*
+ * boot_alloc - Carve a block from the bootstrap arena. Each block is
+ *     preceded by its size so that realloc can copy it out later.
+ */
+static void *boot_alloc(size_t size)
+{
+    size_t asize, old;
+
+    asize = BOOT_HDR + ((size + BOOT_HDR - 1) & ~(size_t)(BOOT_HDR - 1));
+    old = __sync_fetch_and_add(&boot_used, asize);
+    if (size > BOOT_SIZE || old + asize > BOOT_SIZE) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    *(size_t *)(boot_heap + old) = size;
+    return boot_heap + old + BOOT_HDR;
+}
+
+/*
+ * boot_size - Return the payload size of bootstrap block p
+ */
+static size_t boot_size(void *p)
+{
+    return *(size_t *)((char *)p - BOOT_HDR);
+}
+
+/*
+ * free_locked - Release block p, which may be a bootstrap block
+ */
+static void free_locked(void *p)
+{
+    if (IN_BOOT(p))
+	return; /* the bootstrap arena is never reused */
+    mm_free(p);
+}
+
+/*
+ * free_sized_locked - Release block p of size bytes, which may be a
+ *     bootstrap block
+ */
+static void free_sized_locked(void *p, size_t size)
+{
+    if (IN_BOOT(p))
+	return;
+    mm_free_sized(p, size);
+}
+
+/*
+ * usable_size_locked - Return the usable payload bytes at p
+ */
+static size_t usable_size_locked(void *p)
+{
+    if (IN_BOOT(p))
+	return boot_size(p);
+    return mm_usable_size(p);
+}
@@ -0,0 +1,378 @@
+/*
+ * trace.c - routines for reading and writing malloc lab trace files,
+ *           in either the text or the binary format (see trace.h).
+ *
+ * The streaming routines (trace_open/trace_next, trace_create/
+ * trace_put) never hold more than one request in memory, so tools can
+ * process traces with hundreds of millions of requests. read_trace
+ * loads a whole trace for the driver, which replays it many times.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "trace.h"
+#include "mm.h"
+
+/* Misc */
+#define MAXLINE     1024 /* max string size */
+#define HDRWIDTH      11 /* text header fields are padded to this width */
+
+/* function prototypes for internal helper routines */
+static int read_header(tracefile_t *tf);
+static int write_header(tracefile_t *tf);
+static int read_hint(tracefile_t *tf);
+static void trace_error(char *msg);
+
+/*
+ * trace_open - Open a trace file for reading and parse its header.
+ *     Returns NULL if the file cannot be opened or has a bad header.
+ */
+tracefile_t *trace_open(const char *path)
+{
+    tracefile_t *tf;
+
+    if ((tf = (tracefile_t *)calloc(1, sizeof(tracefile_t))) == NULL)
+	return NULL;
+    if ((tf->fp = fopen(path, "r")) == NULL ||
+	(tf->path = strdup(path)) == NULL ||
+	read_header(tf) < 0) {
+	trace_close(tf);
+	return NULL;
+    }
+    tf->max_index = -1;
+    return tf;
+}
+
+/*
+ * trace_next - Read the next request into op. Returns 1 if a request
+ *     was read, 0 at the end of the trace and -1 on a malformed request.
+ */
+int trace_next(tracefile_t *tf, traceop_t *op)
+{
+    char type[MAXLINE];
+    unsigned index = 0, size = 0, align = 0;
+    int hint = MM_HINT_NONE;
+    tracerec_t rec;
+
+    if (tf->binary) {
+	if (fread(&rec, sizeof(rec), 1, tf->fp) != 1)
+	    return 0;
+	type[0] = rec.op;
+	index = rec.index;
+	size = rec.size;
+	if (rec.op == 'm')
+	    align = (rec.align_log2 < 31) ? 1u << rec.align_log2 : 0;
+	hint = rec.hint;
+    }
+    else {
+	if (fscanf(tf->fp, "%s", type) != 1)
+	    return 0;
+	if (type[0] == 'a' || type[0] == 'r' || type[0] == 'c') {
+	    if (fscanf(tf->fp, "%u %u", &index, &size) != 2)
+		type[0] = '?';
+	    else if (type[0] != 'r')
+		hint = read_hint(tf);
+	}
+	else if (type[0] == 'f') {
+	    if (fscanf(tf->fp, "%u", &index) != 1)
+		type[0] = '?';
+	}
+	else if (type[0] == 'm') {
+	    if (fscanf(tf->fp, "%u %u %u", &index, &size, &align) != 3)
+		type[0] = '?';
+	    else
+		hint = read_hint(tf);
+	}
+    }
+
+    if (hint < MM_HINT_NONE || hint > MM_HINT_PERMANENT) {
+	fprintf(stderr, "Bad lifetime hint in tracefile %s\n", tf->path);
+	return -1;
+    }
+
+    switch (type[0]) {
+    case 'a':
+	op->type = ALLOC;
+	break;
+    case 'r':
+	op->type = REALLOC;
+	break;
+    case 'f':
+	op->type = FREE;
+	break;
+    case 'c':
+	op->type = CALLOC;
+	break;
+    case 'm':
+	op->type = MEMALIGN;
+	if (align == 0 || align > (1u << 30) || (align & (align - 1))) {
+	    fprintf(stderr, "Bad alignment (%u) in tracefile %s\n",
+		    align, tf->path);
+	    return -1;
+	}
+	break;
+    default:
+	fprintf(stderr, "Bogus type character (%c) in tracefile %s\n",
+		type[0], tf->path);
+	return -1;
+    }
+    op->index = index;
+    op->size = size;
+    op->align = align;
+    op->hint = (op->type == FREE || op->type == REALLOC) ? MM_HINT_NONE : hint;
+    tf->max_index = ((int)index > tf->max_index) ? (int)index : tf->max_index;
+    tf->ops_done++;
+    return 1;
+}
+
+/*
+ * read_hint - Read the rest of a text request line, which may hold a
+ *     lifetime hint. Returns the hint, MM_HINT_NONE if there is none,
+ *     or -1 if there is something else.
+ */
+static int read_hint(tracefile_t *tf)
+{
+    char line[MAXLINE], h;
+
+    if (fgets(line, MAXLINE, tf->fp) == NULL || sscanf(line, " %c", &h) != 1)
+	return MM_HINT_NONE;
+    switch (h) {
+    case 's':
+	return MM_HINT_SHORT;
+    case 'l':
+	return MM_HINT_LONG;
+    case 'p':
+	return MM_HINT_PERMANENT;
+    default:
+	return -1;
+    }
+}
+
+/*
+ * trace_create - Create a trace file for writing. The header is
+ *     written with placeholder counts and filled in by trace_close,
+ *     so path must name a seekable file.
+ */
+tracefile_t *trace_create(const char *path, int binary)
+{
+    tracefile_t *tf;
+
+    if ((tf = (tracefile_t *)calloc(1, sizeof(tracefile_t))) == NULL)
+	return NULL;
+    tf->binary = binary;
+    tf->writing = 1;
+    tf->max_index = -1;
+    tf->weight = 1;
+    if ((tf->fp = fopen(path, "w")) == NULL ||
+	(tf->path = strdup(path)) == NULL ||
+	write_header(tf) < 0) {
+	tf->writing = 0;
+	trace_close(tf);
+	return NULL;
+    }
+    return tf;
+}
+
+/*
+ * trace_put - Append one request to a trace opened by trace_create.
+ *     Returns 0 on success and -1 on a write error.
+ */
+int trace_put(tracefile_t *tf, const traceop_t *op)
+{
+    tracerec_t rec;
+    int rc;
+
+    if (tf->binary) {
+	memset(&rec, 0, sizeof(rec));
+	rec.op = (op->type == ALLOC) ? 'a' : (op->type == REALLOC) ? 'r' :
+	    (op->type == MEMALIGN) ? 'm' : (op->type == CALLOC) ? 'c' : 'f';
+	rec.index = op->index;
+	rec.size = (op->type == FREE) ? 0 : op->size;
+	if (op->type == MEMALIGN)
+	    while ((1 << rec.align_log2) < op->align)
+		rec.align_log2++;
+	if (op->type != FREE && op->type != REALLOC)
+	    rec.hint = op->hint;
+	rc = (fwrite(&rec, sizeof(rec), 1, tf->fp) == 1) ? 0 : -1;
+    }
+    else if (op->type == FREE)
+	rc = (fprintf(tf->fp, "f %d\n", op->index) < 0) ? -1 : 0;
+    else if (op->type == REALLOC)
+	rc = (fprintf(tf->fp, "r %d %d\n", op->index, op->size) < 0) ? -1 : 0;
+    else {
+	if (op->type == MEMALIGN)
+	    rc = fprintf(tf->fp, "m %d %d %d", op->index, op->size, op->align);
+	else
+	    rc = fprintf(tf->fp, "%c %d %d", (op->type == ALLOC) ? 'a' : 'c',
+			 op->index, op->size);
+	if (rc >= 0 && op->hint != MM_HINT_NONE)
+	    rc = fprintf(tf->fp, " %c", (op->hint == MM_HINT_SHORT) ? 's' :
+			 (op->hint == MM_HINT_LONG) ? 'l' : 'p');
+	if (rc >= 0)
+	    rc = fprintf(tf->fp, "\n");
+	rc = (rc < 0) ? -1 : 0;
+    }
+
+    tf->max_index = (op->index > tf->max_index) ? op->index : tf->max_index;
+    tf->ops_done++;
+    return rc;
+}
+
+/*
+ * trace_close - Close a trace file. For a trace being written, first
+ *     rewrite the header with the final id and request counts. Returns
+ *     0 on success and -1 if anything could not be written.
+ */
+int trace_close(tracefile_t *tf)
+{
+    int rc = 0;
+
+    if (tf->writing) {
+	tf->num_ids = tf->max_index + 1;
+	tf->num_ops = tf->ops_done;
+	if (fseek(tf->fp, 0L, SEEK_SET) < 0 || write_header(tf) < 0)
+	    rc = -1;
+    }
+    if (tf->fp != NULL && fclose(tf->fp) == EOF)
+	rc = -1;
+    free(tf->path);
+    free(tf);
+    return rc;
+}
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+    tracefile_t *tf;
+    trace_t *trace;
+    char path[MAXLINE];
+    char msg[MAXLINE];
+    int op_index, rc = 0;
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	trace_error("malloc 1 failed in read_trance");
+
+    /* Read the trace file header */
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((tf = trace_open(path)) == NULL) {
+	sprintf(msg, "Could not open %s in read_trace", path);
+	trace_error(msg);
+    }
+    trace->sugg_heapsize = tf->sugg_heapsize; /* not used */
+    trace->num_ids = tf->num_ids;
+    trace->num_ops = tf->num_ops;
+    trace->weight = tf->weight;               /* not used */
+
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops =
+	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	trace_error("malloc 2 failed in read_trace");
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks =
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	trace_error("malloc 3 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes =
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	trace_error("malloc 4 failed in read_trace");
+
+    /* read every request line in the trace file */
+    op_index = 0;
+    while (op_index < trace->num_ops &&
+	   (rc = trace_next(tf, &trace->ops[op_index])) == 1)
+	op_index++;
+    if (rc < 0)
+	exit(1);
+    assert(tf->max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+    trace_close(tf);
+
+    return trace;
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    free(trace->ops);         /* free the three arrays... */
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
+
+/* The remaining routines are internal helper routines */
+
+/*
+ * read_header - Detect the trace format and read the four header
+ *     fields. Returns 0 on success, -1 on a truncated header.
+ */
+static int read_header(tracefile_t *tf)
+{
+    char magic[TRACE_MAGIC_LEN];
+    int32_t hdr[4];
+    size_t n;
+
+    n = fread(magic, 1, TRACE_MAGIC_LEN, tf->fp);
+    if (n == TRACE_MAGIC_LEN && !memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN)) {
+	tf->binary = 1;
+	if (fread(hdr, sizeof(hdr), 1, tf->fp) != 1)
+	    return -1;
+	tf->sugg_heapsize = hdr[0];
+	tf->num_ids = hdr[1];
+	tf->num_ops = hdr[2];
+	tf->weight = hdr[3];
+	return 0;
+    }
+
+    rewind(tf->fp);
+    if (fscanf(tf->fp, "%d %d %d %d", &tf->sugg_heapsize, &tf->num_ids,
+	       &tf->num_ops, &tf->weight) != 4)
+	return -1;
+    return 0;
+}
+
+/*
+ * write_header - Write the header fields at the current position. Text
+ *     fields are padded to a fixed width so that trace_close can
+ *     overwrite the placeholders in place.
+ */
+static int write_header(tracefile_t *tf)
+{
+    int32_t hdr[4];
+
+    if (tf->binary) {
+	hdr[0] = tf->sugg_heapsize;
+	hdr[1] = tf->num_ids;
+	hdr[2] = tf->num_ops;
+	hdr[3] = tf->weight;
+	if (fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, tf->fp) != TRACE_MAGIC_LEN ||
+	    fwrite(hdr, sizeof(hdr), 1, tf->fp) != 1)
+	    return -1;
+	return 0;
+    }
+    if (fprintf(tf->fp, "%-*d\n%-*d\n%-*d\n%-*d\n",
+		HDRWIDTH, tf->sugg_heapsize, HDRWIDTH, tf->num_ids,
+		HDRWIDTH, tf->num_ops, HDRWIDTH, tf->weight) < 0)
+	return -1;
+    return 0;
+}
+
+/*
+ * trace_error - Report a Unix-style error and exit
+ */
+static void trace_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
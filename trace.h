@@ -0,0 +1,93 @@
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+/*
+ * trace.h - reading and writing malloc lab trace files
+ *
+ * A trace file is either the classic text format
+ *
+ *	<sugg_heapsize>
+ *	<num_ids>
+ *	<num_ops>
+ *	<weight>
+ *	a <id> <bytes>
+ *	r <id> <bytes>
+ *	f <id>
+ *	m <id> <bytes> <align>
+ *	c <id> <bytes>
+ *	...
+ *
+ * where 'm' allocates a block aligned to <align>, a power of two, as
+ * mm_memalign does, and 'c' allocates a zeroed block, as mm_calloc
+ * does. An 'a', 'm' or 'c' line may end in a lifetime hint for the
+ * block: 's' (short), 'l' (long) or 'p' (permanent), as passed to
+ * mm_malloc_hint.
+ *
+ * or a binary equivalent that starts with TRACE_MAGIC, followed by the
+ * four header fields as 32-bit integers in host byte order and then one
+ * tracerec_t per request. Both are read by the same routines.
+ */
+#include <stdio.h>
+#include <stdint.h>
+
+/* First bytes of a binary trace file */
+#define TRACE_MAGIC     "MMTRACE1"
+#define TRACE_MAGIC_LEN 8
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC, MEMALIGN, CALLOC} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+    int align;                        /* alignment of memalign request */
+    int hint;                         /* lifetime hint of an allocation,
+					 MM_HINT_NONE if there is none */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+} trace_t;
+
+/* On-disk form of one request in a binary trace */
+typedef struct {
+    uint8_t op;          /* 'a', 'r', 'f', 'm' or 'c', as in the text format */
+    uint8_t align_log2;  /* log2 of the alignment for 'm', else zero */
+    uint8_t hint;        /* MM_HINT_* lifetime hint of an allocation */
+    uint8_t reserved;    /* must be zero */
+    uint32_t index;      /* block id */
+    uint32_t size;       /* byte size, 0 for 'f' */
+} tracerec_t;
+
+/* An open trace file, read or written one request at a time */
+typedef struct {
+    FILE *fp;
+    char *path;          /* name used in error messages */
+    int binary;          /* nonzero for the binary format */
+    int writing;         /* opened by trace_create */
+    int sugg_heapsize;   /* header fields, as read or to be written */
+    int num_ids;
+    int num_ops;
+    int weight;
+    int max_index;       /* largest id seen so far, -1 if none */
+    int ops_done;        /* requests read or written so far */
+} tracefile_t;
+
+/* Streaming access, for traces too large to hold in memory */
+tracefile_t *trace_open(const char *path);
+int trace_next(tracefile_t *tf, traceop_t *op);
+tracefile_t *trace_create(const char *path, int binary);
+int trace_put(tracefile_t *tf, const traceop_t *op);
+int trace_close(tracefile_t *tf);
+
+/* Whole-trace access, as used by the driver */
+trace_t *read_trace(char *tracedir, char *filename);
+void free_trace(trace_t *trace);
+
+#endif /* __TRACE_H_ */